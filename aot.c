@@ -0,0 +1,661 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * ahead-of-time translation of a UM program into C.
+ *
+ * the program can be a snapshot, say of one that unpacked itself into
+ * another array and loaded that. the translation then picks the snapshot up
+ * at run time and starts where it left off.
+ *
+ * every reachable instruction becomes a few lines of C working on eight
+ * local registers. blocks start at pc 0, at every value a loadimm could
+ * hand a jump, and at jump targets found by following loadimms through a
+ * block. those are the only places a jump can land in translated code, and
+ * the only labels in the jump table. a jump anywhere else leaves translated
+ * code for the interpreter. so does an instruction that fails, to have the
+ * interpreter run it again and say what went wrong.
+ *
+ * the translation is only good while the words it was made from stay as
+ * they were. programs keep data in array 0 too, so writes to array 0 are
+ * fine as long as they leave translated words alone, and so is a loadprog
+ * of an array that has the same code. a write or loadprog that changes code
+ * the entry point can get to without an indirect jump leaves for the
+ * interpreter for the rest of the run. blocks that are only there because
+ * of a loadimm are often data, so changing one of those drops its run from
+ * the jump table instead. translated code still holding on to a dropped
+ * block leaves for the interpreter on the way in: a write into the block
+ * that is running, and a direct jump or fallthrough into one that is gone.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "aot.h"
+
+/* what the analysis knows about a word. the generated code gets these. */
+enum {
+    /* a block starts here. these are the jump table entries. */
+    W_LEADER = 1,
+    /* straight-line code from a block start gets here */
+    W_LIVE = 2,
+    /* so does control from the entry point, without an indirect jump */
+    W_SURE = 4,
+    /* a straight-line run of live words starts here */
+    W_RUN = 8
+};
+
+/* registers a block loaded with loadimm, and what with */
+typedef struct consts_t {
+    uint8_t known;
+    uint32_t v[8];
+} consts_t;
+
+#define OP(w) ((unsigned)((w) >> 28))
+#define RA(w) ((unsigned)(((w) >> 6) & 7))
+#define RB(w) ((unsigned)(((w) >> 3) & 7))
+#define RC(w) ((unsigned)((w) & 7))
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* halt, loadprog and invalid instructions end a block */
+static inline bool
+ends_block(uint32_t w)
+{
+    return 7 == OP(w) || 12 == OP(w) || OP(w) > 13;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline bool
+known(const consts_t *k,
+      unsigned r)
+{
+    return 0 != ((k->known >> r) & 1);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* where the jump w goes if we can tell, UINT32_MAX if not */
+static inline uint32_t
+jump_target(const consts_t *k,
+            uint32_t w,
+            size_t n)
+{
+    if (known(k, RB(w)) && 0 == k->v[RB(w)] &&
+        known(k, RC(w)) && k->v[RC(w)] < n) {
+        return k->v[RC(w)];
+    }
+    return UINT32_MAX;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+consts_step(consts_t *k,
+            uint32_t w)
+{
+    switch (OP(w)) {
+        case 13: {
+            unsigned a = (unsigned)((w >> 25) & 7);
+            k->known |= (uint8_t)(1U << a);
+            k->v[a] = w & 0x01FFFFFFU;
+            break;
+        }
+        case 0: case 1: case 3: case 4: case 5: case 6:
+            k->known &= (uint8_t)~(1U << RA(w));
+            break;
+        case 8:
+            k->known &= (uint8_t)~(1U << RB(w));
+            break;
+        case 11:
+            k->known &= (uint8_t)~(1U << RC(w));
+            break;
+        default:
+            break;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * finds the blocks. a jump target found in the middle of a block splits it,
+ * and what was known about registers past the split no longer holds, so go
+ * over everything again until no new targets turn up.
+ */
+static void
+analyse(const uint32_t *w,
+        size_t n,
+        uint32_t entry,
+        uint8_t *flags)
+{
+    bool more = true;
+    size_t pc;
+
+    flags[0] |= W_LEADER;
+    if (entry < n) {
+        flags[entry] |= W_LEADER;
+    }
+    for (pc = 0; pc < n; ++pc) {
+        if (13 == OP(w[pc]) && (w[pc] & 0x01FFFFFFU) < n) {
+            flags[w[pc] & 0x01FFFFFFU] |= W_LEADER;
+        }
+    }
+    while (more) {
+        consts_t k;
+        bool live = false;
+
+        more = false;
+        (void)memset(&k, 0, sizeof(k));
+        for (pc = 0; pc < n; ++pc) {
+            if (flags[pc] & W_LEADER) {
+                live = true;
+                k.known = 0;
+            }
+            if (!live) continue;
+            flags[pc] |= W_LIVE;
+            if (12 == OP(w[pc])) {
+                uint32_t t = jump_target(&k, w[pc], n);
+                if (UINT32_MAX != t && !(flags[t] & W_LEADER)) {
+                    flags[t] |= W_LEADER;
+                    more = true;
+                }
+            }
+            consts_step(&k, w[pc]);
+            if (ends_block(w[pc])) live = false;
+        }
+    }
+    for (pc = 0; pc < n; ++pc) {
+        if ((flags[pc] & W_LIVE) &&
+            (0 == pc || !(flags[pc - 1] & W_LIVE) || ends_block(w[pc - 1]))) {
+            flags[pc] |= W_RUN;
+        }
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* marks what the entry points get to through fallthrough and known jumps */
+static int
+mark_sure(const uint32_t *w,
+          size_t n,
+          uint32_t entry,
+          uint8_t *flags)
+{
+    uint32_t *todo = NULL;
+    size_t ntodo = 0;
+
+    /* every leader goes on the list at most once */
+    if (NULL == (todo = malloc(n * sizeof(*todo)))) {
+        return -1;
+    }
+    todo[ntodo++] = 0;
+    if (0 != entry && entry < n) {
+        todo[ntodo++] = entry;
+    }
+    flags[0] |= W_SURE;
+    if (entry < n) {
+        flags[entry] |= W_SURE;
+    }
+    while (0 != ntodo) {
+        size_t pc = todo[--ntodo];
+        consts_t k;
+
+        (void)memset(&k, 0, sizeof(k));
+        for (; pc < n; ++pc) {
+            if (flags[pc] & W_LEADER) {
+                k.known = 0;
+            }
+            flags[pc] |= W_SURE;
+            if (12 == OP(w[pc])) {
+                uint32_t t = jump_target(&k, w[pc], n);
+                if (UINT32_MAX != t && !(flags[t] & W_SURE)) {
+                    flags[t] |= W_SURE;
+                    todo[ntodo++] = t;
+                }
+            }
+            consts_step(&k, w[pc]);
+            if (ends_block(w[pc]) ||
+                (pc + 1 < n && (flags[pc + 1] & W_SURE))) {
+                break;
+            }
+        }
+    }
+    free(todo);
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static const char preamble[] =
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <string.h>\n"
+"#include <inttypes.h>\n"
+"\n"
+"#include \"vmdeux.h\"\n"
+"\n"
+"/* leaves translated code for the interpreter at p, k into a block */\n"
+"#define LEAVE(p, k) do { pc = (p); ic += (k); goto leave; } while (0)\n"
+"\n"
+"/*\n"
+" * aupd at p, k into a block that ends before e. carries on if our code is\n"
+" * left alone, or if what changed is only reachable through blocks we drop.\n"
+" */\n"
+"#define AUPD(p, k, e, ra, rb, rc)                                      \\\n"
+"do {                                                                   \\\n"
+"    int s_ = aupd(vm, &z, &zn, (ra), (rb), (rc));                      \\\n"
+"    if (0 > s_) LEAVE((p), (k));                                       \\\n"
+"    if (0 < s_) {                                                      \\\n"
+"        if ((code[(rb)] & W_SURE) ||                                   \\\n"
+"            ((rb) >= (p) - (k) && (rb) < (e))) {                       \\\n"
+"            LEAVE((p) + 1, (k) + 1);                                   \\\n"
+"        }                                                              \\\n"
+"        drop(blocks, (rb));                                            \\\n"
+"    }                                                                  \\\n"
+"} while (0)\n"
+"\n"
+"/* goes on to block t, k into this one, unless t was dropped */\n"
+"#define ENTER(t, k)                                                    \\\n"
+"do {                                                                   \\\n"
+"    if (NULL == blocks[(t)]) LEAVE((t), (k));                          \\\n"
+"    ic += (k);                                                         \\\n"
+"    goto L##t;                                                         \\\n"
+"} while (0)\n"
+"\n"
+"/* loadprog at p, k into a block. carries on if it loaded our code. */\n"
+"#define LOADPROG(p, k, rb, rc)                                         \\\n"
+"do {                                                                   \\\n"
+"    if (0 != (rb)) {                                                   \\\n"
+"        int s_ = loadprog(vm, blocks, &z, &zn, (rb));                  \\\n"
+"        if (0 > s_) LEAVE((p), (k));                                   \\\n"
+"        if (0 < s_) LEAVE((rc), (k) + 1);                              \\\n"
+"    }                                                                  \\\n"
+"} while (0)\n"
+"\n";
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static const char helpers[] =
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"static inline int\n"
+"is_code(size_t idx)\n"
+"{\n"
+"    return idx < N_WORDS && 0 != (code[idx] & W_LIVE);\n"
+"}\n"
+"\n"
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"/* takes the blocks that run into word idx out of the jump table */\n"
+"static void\n"
+"drop(const void **blocks,\n"
+"     size_t idx)\n"
+"{\n"
+"    for (; 0 == (code[idx] & W_RUN); --idx) {\n"
+"        blocks[idx] = NULL;\n"
+"    }\n"
+"    blocks[idx] = NULL;\n"
+"}\n"
+"\n"
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"/*\n"
+" * 0 if array 0 (z, zn words) still has the code the entry point gets to,\n"
+" * after dropping blocks that changed. 1 if not.\n"
+" */\n"
+"static int\n"
+"check_code(const void **blocks,\n"
+"           const uint32_t *z,\n"
+"           size_t zn)\n"
+"{\n"
+"    size_t i;\n"
+"\n"
+"    for (i = 0; i < N_WORDS; ++i) {\n"
+"        if (!is_code(i) || (i < zn && z[i] == zero[i])) continue;\n"
+"        if (code[i] & W_SURE) return 1;\n"
+"        drop(blocks, i);\n"
+"    }\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"static inline int\n"
+"aidx(vmdeux_t *vm,\n"
+"     const uint32_t *z,\n"
+"     size_t zn,\n"
+"     uint32_t id,\n"
+"     uint32_t idx,\n"
+"     uint32_t *val)\n"
+"{\n"
+"    if (0 == id) {\n"
+"        if (idx >= zn) return -1;\n"
+"        *val = z[idx];\n"
+"        return 0;\n"
+"    }\n"
+"    return vmdeux_aidx(vm, id, idx, val);\n"
+"}\n"
+"\n"
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"/* 0 if our code is left as it was, 1 if not, -1 if the write failed */\n"
+"static inline int\n"
+"aupd(vmdeux_t *vm,\n"
+"     const uint32_t **z,\n"
+"     size_t *zn,\n"
+"     uint32_t id,\n"
+"     uint32_t idx,\n"
+"     uint32_t val)\n"
+"{\n"
+"    if (VMDEUX_SUCCESS != vmdeux_aupd(vm, id, idx, val)) return -1;\n"
+"    if (0 != id) return 0;\n"
+"    /* the first write gets array 0 a payload of its own */\n"
+"    *z = vmdeux_zero(vm, zn);\n"
+"    return (is_code(idx) && val != zero[idx]) ? 1 : 0;\n"
+"}\n"
+"\n"
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"/* 0 if the loadprog brought in our code, 1 if not, -1 if it failed */\n"
+"static inline int\n"
+"loadprog(vmdeux_t *vm,\n"
+"         const void **blocks,\n"
+"         const uint32_t **z,\n"
+"         size_t *zn,\n"
+"         uint32_t id)\n"
+"{\n"
+"    if (VMDEUX_SUCCESS != vmdeux_loadprog(vm, id)) return -1;\n"
+"    *z = vmdeux_zero(vm, zn);\n"
+"    return check_code(blocks, *z, *zn);\n"
+"}\n"
+"\n";
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static const char trailer[] =
+"/* ////////////////////////////////////////////////////////////////////////// */\n"
+"int\n"
+"main(int argc,\n"
+"     char **argv)\n"
+"{\n"
+"    vmdeux_image_t *img = NULL;\n"
+"    vmdeux_t *vm = NULL;\n"
+"    struct vmdeux_regs regs;\n"
+"    struct vmdeux_stats st;\n"
+"    uint64_t icount0 = 0, translated = 0;\n"
+"    int rc = VMDEUX_SUCCESS;\n"
+"\n"
+"#ifdef SNAPSHOT\n"
+"    if (VMDEUX_SUCCESS != vmdeux_create(&vm, NULL) ||\n"
+"        VMDEUX_SUCCESS != vmdeux_load_file(vm, SNAPSHOT)) {\n"
+"#else\n"
+"    if (VMDEUX_SUCCESS != vmdeux_image_wrap(&img, zero, N_WORDS) ||\n"
+"        VMDEUX_SUCCESS != vmdeux_create(&vm, NULL) ||\n"
+"        VMDEUX_SUCCESS != vmdeux_load_shared(vm, img)) {\n"
+"#endif\n"
+"        fprintf(stderr, \"cannot set up the machine\\n\");\n"
+"        return EXIT_FAILURE;\n"
+"    }\n"
+"    vmdeux_get_regs(vm, &regs);\n"
+"    icount0 = regs.icount;\n"
+"    rc = run_translated(vm, &regs);\n"
+"    vmdeux_set_regs(vm, &regs);\n"
+"    translated = regs.icount - icount0;\n"
+"    if (VMDEUX_YIELD == rc) {\n"
+"        rc = vmdeux_run(vm, vmdeux_engine(\"jit\"), UINT64_MAX);\n"
+"    }\n"
+"    (void)vmdeux_flush(vm);\n"
+"    if (VMDEUX_SUCCESS != rc) {\n"
+"        fprintf(stderr, \"run error: %d\\n\", rc);\n"
+"    }\n"
+"    if (2 == argc && 0 == strcmp(argv[1], \"-t\")) {\n"
+"        vmdeux_stats(vm, &st);\n"
+"        fprintf(stderr, \"instructions: %\"PRIu64\" translated: %\"PRIu64\n"
+"                \" interpreted: %\"PRIu64\"\\n\", st.icount - icount0,\n"
+"                translated, st.icount - icount0 - translated);\n"
+"    }\n"
+"    vmdeux_destroy(vm);\n"
+"    vmdeux_image_close(img);\n"
+"    return (VMDEUX_SUCCESS == rc) ? EXIT_SUCCESS : EXIT_FAILURE;\n"
+"}\n";
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * the instruction w at pc, k instructions into its block, which ends before
+ * end. blocks only the entry point gets to are never dropped, so jumps to
+ * those don't check.
+ */
+static void
+emit_insn(FILE *f,
+          const consts_t *kn,
+          const uint8_t *flags,
+          uint32_t w,
+          size_t pc,
+          unsigned k,
+          size_t end,
+          size_t n,
+          bool *halts)
+{
+    unsigned a = RA(w), b = RB(w), c = RC(w);
+
+    switch (OP(w)) {
+        case 0:
+            fprintf(f, "    if (0 != r%u) r%u = r%u;\n", c, a, b);
+            break;
+        case 1:
+            fprintf(f, "    if (0 != aidx(vm, z, zn, r%u, r%u, &t)) "
+                    "LEAVE(%zuU, %u);\n    r%u = t;\n", b, c, pc, k, a);
+            break;
+        case 2:
+            fprintf(f, "    AUPD(%zuU, %u, %zuU, r%u, r%u, r%u);\n", pc, k, end,
+                    a, b, c);
+            break;
+        case 3:
+            fprintf(f, "    r%u = r%u + r%u;\n", a, b, c);
+            break;
+        case 4:
+            fprintf(f, "    r%u = r%u * r%u;\n", a, b, c);
+            break;
+        case 5:
+            fprintf(f, "    if (0 == r%u) LEAVE(%zuU, %u);\n"
+                    "    r%u = r%u / r%u;\n", c, pc, k, a, b, c);
+            break;
+        case 6:
+            fprintf(f, "    r%u = ~(r%u & r%u);\n", a, b, c);
+            break;
+        case 7:
+            fprintf(f, "    pc = %zuU;\n    ic += %u;\n    goto halt;\n", pc,
+                    k + 1);
+            *halts = true;
+            break;
+        case 8:
+            fprintf(f, "    if (VMDEUX_SUCCESS != vmdeux_alloc(vm, r%u, &t)) "
+                    "LEAVE(%zuU, %u);\n    r%u = t;\n", c, pc, k, b);
+            break;
+        case 9:
+            fprintf(f, "    if (VMDEUX_SUCCESS != vmdeux_dealloc(vm, r%u)) "
+                    "LEAVE(%zuU, %u);\n", c, pc, k);
+            break;
+        case 10:
+            fprintf(f, "    vmdeux_out(vm, r%u);\n", c);
+            break;
+        case 11:
+            fprintf(f, "    if (VMDEUX_SUCCESS != vmdeux_in(vm, &t, ic + %u)) "
+                    "LEAVE(%zuU, %u);\n    r%u = t;\n", k, pc, k, c);
+            break;
+        case 12: {
+            uint32_t target = jump_target(kn, w, n);
+            if (UINT32_MAX != target && (flags[target] & W_SURE)) {
+                fprintf(f, "    ic += %u;\n    goto L%"PRIu32";\n", k + 1,
+                        target);
+                break;
+            }
+            if (UINT32_MAX != target) {
+                fprintf(f, "    ENTER(%"PRIu32", %u);\n", target, k + 1);
+                break;
+            }
+            fprintf(f, "    LOADPROG(%zuU, %u, r%u, r%u);\n"
+                    "    ic += %u;\n    pc = r%u;\n    goto dispatch;\n",
+                    pc, k, b, c, k + 1, c);
+            break;
+        }
+        case 13:
+            fprintf(f, "    r%u = 0x%08"PRIx32"U;\n",
+                    (unsigned)((w >> 25) & 7), w & 0x01FFFFFFU);
+            break;
+        default:
+            /* let the interpreter complain */
+            fprintf(f, "    LEAVE(%zuU, %u);\n", pc, k);
+            break;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+emit_code(FILE *f,
+          const uint32_t *w,
+          size_t n,
+          const uint8_t *flags)
+{
+    consts_t kn;
+    bool live = false, halts = false;
+    unsigned k = 0, i;
+    size_t pc, end = 0;
+
+    fprintf(f, "/* ////////////////////////////////////////////////////////"
+            "////////////////// */\n"
+            "/*\n"
+            " * runs from regs->pc until the guest halts (VMDEUX_SUCCESS) or "
+            "the\n"
+            " * interpreter has to take over at regs->pc (VMDEUX_YIELD).\n"
+            " */\n"
+            "static int\n"
+            "run_translated(vmdeux_t *vm,\n"
+            "               struct vmdeux_regs *regs)\n"
+            "{\n"
+            "    static const void *blocks[N_WORDS] = {\n");
+    for (pc = 0; pc < n; ++pc) {
+        if (flags[pc] & W_LEADER) {
+            fprintf(f, "        [%zu] = &&L%zu,\n", pc, pc);
+        }
+    }
+    fprintf(f, "    };\n");
+    for (i = 0; i < 8; ++i) {
+        fprintf(f, "    uint32_t r%u = regs->mr[%u];\n", i, i);
+    }
+    fprintf(f, "    uint32_t pc = regs->pc, t = 0;\n"
+            "    uint64_t ic = regs->icount;\n"
+            "    size_t zn = 0;\n"
+            "    const uint32_t *z = vmdeux_zero(vm, &zn);\n"
+            "    int rc = VMDEUX_YIELD;\n\n"
+            "    /* say, a snapshot taken again since we were translated */\n"
+            "    if (0 != check_code(blocks, z, zn)) goto leave;\n"
+            "    goto dispatch;\n");
+    (void)memset(&kn, 0, sizeof(kn));
+    for (pc = 0; pc < n; ++pc) {
+        if (flags[pc] & W_LEADER) {
+            /* falling into the next block */
+            if (live && (flags[pc] & W_SURE)) {
+                fprintf(f, "    ic += %u;\n", k);
+            }
+            else if (live) {
+                fprintf(f, "    ENTER(%zu, %u);\n", pc, k);
+            }
+            fprintf(f, "L%zu:\n", pc);
+            live = true;
+            k = 0;
+            kn.known = 0;
+            for (end = pc + 1; end < n && !(flags[end] & W_LEADER) &&
+                               !ends_block(w[end - 1]); ++end) {
+            }
+        }
+        if (!live) continue;
+        emit_insn(f, &kn, flags, w[pc], pc, k, end, n, &halts);
+        consts_step(&kn, w[pc]);
+        ++k;
+        if (ends_block(w[pc])) live = false;
+    }
+    if (live) {
+        /* ran off the end of the program */
+        fprintf(f, "    LEAVE(%zuU, %u);\n", n, k);
+    }
+    fprintf(f, "dispatch:\n"
+            "    if (pc >= N_WORDS || NULL == blocks[pc]) goto leave;\n"
+            "    goto *blocks[pc];\n");
+    if (halts) {
+        fprintf(f, "halt:\n    rc = VMDEUX_SUCCESS;\n");
+    }
+    fprintf(f, "leave:\n");
+    for (i = 0; i < 8; ++i) {
+        fprintf(f, "    regs->mr[%u] = r%u;\n", i, i);
+    }
+    fprintf(f, "    regs->pc = pc;\n"
+            "    regs->icount = ic;\n"
+            "    (void)t;\n"
+            "    (void)z;\n"
+            "    return rc;\n"
+            "}\n\n");
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+aot_emit(FILE *f,
+         const uint32_t *w,
+         size_t n,
+         uint32_t entry,
+         const char *src,
+         const char *snapshot)
+{
+    uint8_t *flags = NULL;
+    size_t pc;
+
+    if (0 == n) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (NULL == (flags = calloc(n, sizeof(*flags)))) {
+        return -1;
+    }
+    analyse(w, n, entry, flags);
+    if (0 != mark_sure(w, n, entry, flags)) {
+        free(flags);
+        return -1;
+    }
+    fprintf(f, "/*\n"
+            " * translated from %s by vmdeux --emit-c. build it with\n"
+            " * cc -O2 -I VMDEUX_DIR FILE.c VMDEUX_DIR/libvmdeux.a -pthread\n"
+            " * and run it with -t to see how much of the run stayed "
+            "translated.\n"
+            " */\n\n", src);
+    fputs(preamble, f);
+    if (NULL != snapshot) {
+        /* no escaping. a path that needs any won't compile. */
+        fprintf(f, "/* the machine starts out as this snapshot */\n"
+                "#define SNAPSHOT \"%s\"\n\n", snapshot);
+    }
+    fprintf(f, "#define N_WORDS %zuU\n\n"
+            "/* the program we were made from */\n"
+            "static const uint32_t zero[N_WORDS] = {", n);
+    for (pc = 0; pc < n; ++pc) {
+        fprintf(f, "%s0x%08"PRIx32"U,", (0 == pc % 6) ? "\n    " : " ",
+                w[pc]);
+    }
+    fprintf(f, "\n};\n\n"
+            "/* what the translator made of each word of it */\n"
+            "#define W_LIVE %d\n#define W_SURE %d\n#define W_RUN %d\n"
+            "static const uint8_t code[N_WORDS] = {", W_LIVE, W_SURE, W_RUN);
+    for (pc = 0; pc < n; ++pc) {
+        fprintf(f, "%s%u,", (0 == pc % 16) ? "\n    " : " ",
+                (unsigned)(flags[pc] & ~W_LEADER));
+    }
+    fprintf(f, "\n};\n\n");
+    fputs(helpers, f);
+    emit_code(f, w, n, flags);
+    fputs(trailer, f);
+    free(flags);
+    return ferror(f) ? -1 : 0;
+}
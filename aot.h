@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_AOT_H
+#define VMDEUX_AOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * writes a C translation of the program in w (n words, host byte order) to
+ * f. src names where it came from. the translation keeps its own copy of
+ * the program and runs it with the vmdeux_ runtime calls for translated
+ * code, handing the machine to vmdeux_run once array 0 stops matching that
+ * copy. it starts a new machine at pc 0, or if snapshot isn't NULL, loads
+ * that at run time and starts at entry. returns -1 on failure, with errno
+ * set.
+ */
+int aot_emit(FILE *f, const uint32_t *w, size_t n, uint32_t entry,
+             const char *src, const char *snapshot);
+
+#endif /* VMDEUX_AOT_H */
@@ -0,0 +1,489 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Arena allocator for guest arrays.
+ *
+ * A single address space reservation is committed from the bottom up as
+ * top grows. Blocks are powers of two times ARENA_MIN_BLOCK words up to
+ * ARENA_MAX_CLASS, with a free list per size, so OP9 and a later OP8 of the
+ * same size are a push and a pop. Bigger blocks are rounded to
+ * ARENA_HUGE_ROUND words and share a first-fit list, with any slack split
+ * back off.
+ *
+ * Arrays can't move -- their ids are in guest registers and memory where
+ * they can't be told apart from data -- so compaction here means merging
+ * runs of free blocks into bigger ones, lowering top past free space at the
+ * end, and handing the pages of big free runs back to the kernel.
+ *
+ * Blocks of ARENA_LAZY_MIN words and up give their pages back as soon as
+ * they are freed, and are zeroed by dropping their pages again when they
+ * are reused, so a big array only costs the pages the guest touches.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/* ids are 32 bits, so the arena can't go past 4G words */
+#define ARENA_MAX_WORDS ((1ULL << 32) - ARENA_COMMIT_WORDS)
+/* give up reserving below this */
+#define ARENA_MIN_WORDS (1ULL << 24)
+/* don't bother compacting tiny arenas */
+#define ARENA_COMPACT_MIN (1ULL << 20)
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline int
+size_class(uint64_t nwords)
+{
+    if (nwords <= ARENA_MIN_BLOCK) {
+        return 0;
+    }
+    /* ceil(log2(nwords)) - log2(ARENA_MIN_BLOCK) */
+    return 64 - __builtin_clzll(nwords - 1) - 2;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline uint64_t
+words_pageup(uint64_t off)
+{
+    uint64_t pw = (uint64_t)sysconf(_SC_PAGESIZE) / sizeof(uint32_t);
+
+    return (off + pw - 1) / pw * pw;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* hands the pages wholly inside words [from, to) back to the kernel */
+static void
+drop_pages(struct arena *a,
+           uint64_t from,
+           uint64_t to)
+{
+    uint64_t pw = (uint64_t)sysconf(_SC_PAGESIZE) / sizeof(uint32_t);
+
+    from = words_pageup(from);
+    to = to / pw * pw;
+    if (from < to) {
+        (void)madvise(a->base + from, (to - from) * sizeof(uint32_t),
+                      MADV_DONTNEED);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * zeroes words [from, to). big ranges get fresh pages from the kernel
+ * instead, which it zeroes when (and if) they are touched.
+ */
+static void
+zero_words(struct arena *a,
+           uint64_t from,
+           uint64_t to)
+{
+    uint64_t pw = (uint64_t)sysconf(_SC_PAGESIZE) / sizeof(uint32_t);
+    uint64_t lo = words_pageup(from), hi = to / pw * pw;
+
+    if (to - from < ARENA_LAZY_MIN || lo >= hi) {
+        (void)memset(a->base + from, 0, (to - from) * sizeof(uint32_t));
+        return;
+    }
+    (void)memset(a->base + from, 0, (lo - from) * sizeof(uint32_t));
+    drop_pages(a, lo, hi);
+    (void)memset(a->base + hi, 0, (to - hi) * sizeof(uint32_t));
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* makes words up to end usable */
+static int
+commit(struct arena *a,
+       uint64_t end)
+{
+    uint64_t ncommitted;
+
+    if (likely(end <= a->committed)) {
+        return 0;
+    }
+    ncommitted = (end + ARENA_COMMIT_WORDS - 1) / ARENA_COMMIT_WORDS *
+                 ARENA_COMMIT_WORDS;
+    if (ncommitted > a->reserved) {
+        ncommitted = a->reserved;
+    }
+    if (0 != mprotect(a->base + a->committed,
+                      (ncommitted - a->committed) * sizeof(uint32_t),
+                      PROT_READ | PROT_WRITE)) {
+        return -1;
+    }
+    a->committed = ncommitted;
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct arena *
+arena_create(bool compact)
+{
+    struct arena *a = NULL;
+    uint64_t nwords = ARENA_MAX_WORDS;
+    void *base = MAP_FAILED;
+
+    if (NULL == (a = calloc(1, sizeof(*a)))) {
+        return NULL;
+    }
+    /* address space only. arena_alloc makes it usable as needed. */
+    for (; nwords >= ARENA_MIN_WORDS; nwords /= 2) {
+        base = mmap(NULL, nwords * sizeof(uint32_t), PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED != base) break;
+    }
+    if (MAP_FAILED == base) {
+        free(a);
+        return NULL;
+    }
+    a->base = (uint32_t *)base;
+    a->reserved = nwords;
+    a->compact = compact;
+    /* a block at 0 that is never freed, so 0 can mean an empty list */
+    if (0 != commit(a, ARENA_MIN_BLOCK)) {
+        arena_destroy(a);
+        return NULL;
+    }
+    a->base[0] = ARENA_MIN_BLOCK | ARENA_LIVE;
+    a->top = a->clean = ARENA_MIN_BLOCK;
+    return a;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+arena_destroy(struct arena *a)
+{
+    if (NULL == a) return;
+    (void)munmap(a->base, a->reserved * sizeof(uint32_t));
+    free(a);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* puts one free block on the right list. bsize is a class size or huge. */
+static inline void
+push_free(struct arena *a,
+          uint64_t off,
+          uint64_t bsize)
+{
+    uint32_t *hdr = a->base + off;
+    uint32_t *head = (bsize > ARENA_MAX_CLASS) ? &a->huge
+                                               : &a->cls[size_class(bsize)];
+
+    hdr[0] = (uint32_t)bsize | ARENA_FREE;
+    hdr[1] = 0;
+    hdr[2] = *head;
+    *head = (uint32_t)off;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* frees words [off, off + nwords), cut into class sized blocks if need be */
+static void
+put_free(struct arena *a,
+         uint64_t off,
+         uint64_t nwords)
+{
+    if (nwords > ARENA_MAX_CLASS) {
+        push_free(a, off, nwords);
+        return;
+    }
+    /* nwords is a multiple of ARENA_MIN_BLOCK, so its bits are the pieces */
+    while (0 != nwords) {
+        uint64_t piece = 1ULL << (63 - __builtin_clzll(nwords));
+        push_free(a, off, piece);
+        off += piece;
+        nwords -= piece;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* true if off is a free block of bsize words (any size if bsize is 0) */
+static inline bool
+free_block(const struct arena *a,
+           uint64_t off,
+           uint64_t bsize)
+{
+    const uint32_t *hdr = NULL;
+    uint64_t sz;
+
+    /* stray guest writes can reach a free block's link */
+    if (off + ARENA_MIN_BLOCK > a->top) {
+        return false;
+    }
+    hdr = a->base + off;
+    sz = hdr[0] & ~ARENA_STATE;
+    return ARENA_FREE == (hdr[0] & ARENA_STATE) &&
+           sz >= ARENA_MIN_BLOCK && sz <= a->top - off &&
+           (0 == bsize || sz == bsize);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a free block of at least bsize words off the huge list, or 0 */
+static uint64_t
+take_huge(struct arena *a,
+          uint64_t bsize)
+{
+    uint32_t *link = &a->huge;
+
+    while (0 != *link) {
+        uint64_t off = *link, sz;
+        if (unlikely(!free_block(a, off, 0))) {
+            /* a broken list only costs us the blocks on it */
+            *link = 0;
+            break;
+        }
+        sz = a->base[off] & ~ARENA_STATE;
+        if (sz >= bsize) {
+            *link = a->base[off + 2];
+            if (sz - bsize >= ARENA_MIN_BLOCK) {
+                put_free(a, off + bsize, sz - bsize);
+            }
+            a->free_words -= bsize;
+            return off;
+        }
+        link = &a->base[off + 2];
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* pops a block off class list ci, 0 if there's none */
+static inline uint64_t
+take_class(struct arena *a,
+           int ci)
+{
+    uint64_t bsize = (uint64_t)ARENA_MIN_BLOCK << ci;
+    uint64_t off = a->cls[ci];
+
+    if (0 == off) {
+        return 0;
+    }
+    if (unlikely(!free_block(a, off, bsize))) {
+        a->cls[ci] = 0;
+        return 0;
+    }
+    a->cls[ci] = a->base[off + 2];
+    a->free_words -= bsize;
+    return off;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a block for class ci cut from a bigger free block, or 0 */
+static uint64_t
+split_bigger(struct arena *a,
+             int ci)
+{
+    uint64_t bsize = (uint64_t)ARENA_MIN_BLOCK << ci, off;
+    int c;
+
+    for (c = ci + 1; c < ARENA_N_CLASSES; ++c) {
+        if (0 != (off = take_class(a, c))) {
+            uint64_t rest = ((uint64_t)ARENA_MIN_BLOCK << c) - bsize;
+            put_free(a, off + bsize, rest);
+            a->free_words += rest;
+            return off;
+        }
+    }
+    return take_huge(a, bsize);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+arena_alloc(struct arena *a,
+            uint32_t len,
+            uint32_t *id)
+{
+    uint64_t need = (uint64_t)len + ARENA_HDR, bsize, off = 0;
+    uint32_t *hdr = NULL;
+
+    if (need <= ARENA_MAX_CLASS) {
+        int ci = size_class(need);
+        bsize = (uint64_t)ARENA_MIN_BLOCK << ci;
+        if (0 == (off = take_class(a, ci)) && 0 != a->free_words) {
+            off = split_bigger(a, ci);
+        }
+    }
+    else {
+        bsize = (need + ARENA_HUGE_ROUND - 1) / ARENA_HUGE_ROUND *
+                ARENA_HUGE_ROUND;
+        off = take_huge(a, bsize);
+    }
+    if (0 != off) {
+        a->hits++;
+    }
+    else {
+        if (bsize > a->reserved - a->top || 0 != commit(a, a->top + bsize)) {
+            return -1;
+        }
+        off = a->top;
+        a->top += bsize;
+        a->misses++;
+    }
+    hdr = a->base + off;
+    hdr[0] = (uint32_t)bsize | ARENA_LIVE;
+    hdr[1] = len;
+    /* only what was used before needs clearing */
+    if (off + ARENA_HDR < a->clean) {
+        uint64_t dirty = a->clean - off - ARENA_HDR;
+        zero_words(a, off + ARENA_HDR,
+                   off + ARENA_HDR + (dirty < len ? dirty : len));
+    }
+#ifdef MADV_HUGEPAGE
+    if (a->thp && bsize >= ARENA_THP_MIN) {
+        uint64_t pw = (uint64_t)sysconf(_SC_PAGESIZE) / sizeof(uint32_t);
+        uint64_t lo = words_pageup(off), hi = (off + bsize) / pw * pw;
+        (void)madvise(a->base + lo, (hi - lo) * sizeof(uint32_t),
+                      MADV_HUGEPAGE);
+    }
+#endif
+    if (a->top > a->clean) {
+        a->clean = a->top;
+    }
+    *id = (uint32_t)(off + ARENA_HDR);
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+bool
+arena_live(const struct arena *a,
+           uint32_t id)
+{
+    const uint32_t *hdr = NULL;
+    uint64_t off, sz;
+
+    /* the first real block comes after the one at 0 */
+    if (id < ARENA_MIN_BLOCK + ARENA_HDR || id >= a->top) {
+        return false;
+    }
+    off = id - ARENA_HDR;
+    hdr = a->base + off;
+    sz = hdr[0] & ~ARENA_STATE;
+    return ARENA_LIVE == (hdr[0] & ARENA_STATE) && 0 == off % ARENA_MIN_BLOCK &&
+           sz >= ARENA_MIN_BLOCK && sz <= a->top - off &&
+           hdr[1] <= sz - ARENA_HDR;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+arena_free(struct arena *a,
+           uint32_t id,
+           uint32_t *len)
+{
+    uint64_t off, bsize;
+
+    if (unlikely(!arena_live(a, id))) {
+        return -1;
+    }
+    off = id - ARENA_HDR;
+    bsize = a->base[off] & ~ARENA_STATE;
+    *len = a->base[off + 1];
+    if (bsize >= ARENA_LAZY_MIN) {
+        /* the header and link stay in the first page */
+        drop_pages(a, off + ARENA_MIN_BLOCK, off + bsize);
+        a->dropped += bsize;
+    }
+    push_free(a, off, bsize);
+    a->free_words += bsize;
+    a->frees++;
+    a->freed_since += bsize;
+    /* the walk is paid for by a quarter of the arena freed since the last */
+    if (a->compact && a->top >= ARENA_COMPACT_MIN &&
+        a->free_words >= a->top / 2 && a->freed_since >= a->top / 4) {
+        arena_compact(a);
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* frees the run of free words [from, to) in as few blocks as it can */
+static void
+release_run(struct arena *a,
+            uint64_t from,
+            uint64_t to)
+{
+    /* the headers put_free writes land in the first page of each piece */
+    drop_pages(a, from + ARENA_MIN_BLOCK, to);
+    put_free(a, from, to - from);
+    a->free_words += to - from;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+arena_compact(struct arena *a)
+{
+    uint64_t off = 0, run = 0;
+    bool in_run = false;
+
+    (void)memset(a->cls, 0, sizeof(a->cls));
+    a->huge = 0;
+    a->free_words = 0;
+    a->freed_since = 0;
+    a->compactions++;
+    while (off < a->top) {
+        const uint32_t *hdr = a->base + off;
+        uint64_t sz = hdr[0] & ~ARENA_STATE;
+        if (unlikely(sz < ARENA_MIN_BLOCK || sz > a->top - off ||
+                     0 == (hdr[0] & ARENA_STATE))) {
+            /* a stray write got to a header. what's past it stays lost. */
+            in_run = false;
+            break;
+        }
+        if (ARENA_FREE == (hdr[0] & ARENA_STATE)) {
+            if (!in_run) {
+                run = off;
+                in_run = true;
+            }
+        }
+        else if (in_run) {
+            release_run(a, run, off);
+            in_run = false;
+        }
+        off += sz;
+    }
+    if (in_run) {
+        /* free all the way up: lower top instead */
+        uint64_t clean = words_pageup(run);
+        /* commits are whole pages, so this stays inside them */
+        drop_pages(a, run, words_pageup(a->clean));
+        a->trimmed += a->top - run;
+        a->top = run;
+        if (clean < a->clean) {
+            a->clean = clean;
+        }
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+arena_stats(const struct arena *a,
+            FILE *f)
+{
+    fprintf(f, "arena: reserved: %"PRIu64" MiB top: %"PRIu64" words free: "
+            "%"PRIu64" words\n", a->reserved * sizeof(uint32_t) >> 20,
+            a->top, a->free_words);
+    fprintf(f, "arena: allocs from free lists: %"PRIu64" from top: %"PRIu64
+            " frees: %"PRIu64" compactions: %"PRIu64" words trimmed: %"PRIu64
+            " dropped: %"PRIu64"\n", a->hits, a->misses, a->frees,
+            a->compactions, a->trimmed, a->dropped);
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_ARENA_H
+#define VMDEUX_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* words in front of every block: block size (plus state bits) and length */
+#define ARENA_HDR 2
+/* smallest block in words: the header and a free list link, rounded up */
+#define ARENA_MIN_BLOCK 4
+/* free list i holds blocks of ARENA_MIN_BLOCK << i words */
+#define ARENA_N_CLASSES 20
+#define ARENA_MAX_CLASS (ARENA_MIN_BLOCK << (ARENA_N_CLASSES - 1))
+/* bigger blocks are rounded up to this many words and share one list */
+#define ARENA_HUGE_ROUND 1024
+/* reserved address space is made usable this many words at a time */
+#define ARENA_COMMIT_WORDS (1 << 19)
+/* blocks this big are zeroed and freed by the page, not by memset */
+#define ARENA_LAZY_MIN (1 << 16)
+/* blocks this big are offered transparent huge pages */
+#define ARENA_THP_MIN (1 << 19)
+
+/* block state, in the low bits of the size word */
+#define ARENA_LIVE 0x1U
+#define ARENA_FREE 0x2U
+#define ARENA_STATE 0x3U
+
+/*
+ * one big reservation that the arrays of a machine are carved out of. an
+ * array's id is the word offset of its first element, so finding it is just
+ * base + id. the header sits right in front:
+ *
+ *   base + id - 2: block size in words | state
+ *   base + id - 1: array length in words (0 once freed)
+ *
+ * blocks are laid end to end from offset 0 up to top.
+ */
+struct arena {
+    uint32_t *base;
+    /* words reserved, usable and handed out */
+    uint64_t reserved;
+    uint64_t committed;
+    uint64_t top;
+    /* every word from here up is known to be zero */
+    uint64_t clean;
+    /* free list heads by size class (block offsets), 0 if empty */
+    uint32_t cls[ARENA_N_CLASSES];
+    /* free blocks bigger than ARENA_MAX_CLASS */
+    uint32_t huge;
+    /* words in free blocks */
+    uint64_t free_words;
+    /* coalesce free blocks once half the arena is free */
+    bool compact;
+    /* ask for transparent huge pages for big blocks */
+    bool thp;
+    /* words freed since the last arena_compact */
+    uint64_t freed_since;
+    /* blocks from a free list and from top */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t frees;
+    uint64_t compactions;
+    /* words given back by trimming top */
+    uint64_t trimmed;
+    /* words of big blocks handed back to the kernel on free */
+    uint64_t dropped;
+};
+
+/* NULL if no address space could be reserved */
+struct arena *arena_create(bool compact);
+void arena_destroy(struct arena *a);
+/* id of a new zeroed array of len words. -1 if there's no room. */
+int arena_alloc(struct arena *a, uint32_t len, uint32_t *id);
+/* stores the array's length. -1 if id doesn't look like a live array. */
+int arena_free(struct arena *a, uint32_t id, uint32_t *len);
+/* true if id looks like a live array */
+bool arena_live(const struct arena *a, uint32_t id);
+/* merges neighbouring free blocks and gives back free space at the top */
+void arena_compact(struct arena *a);
+void arena_stats(const struct arena *a, FILE *f);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * array id and its length, NULL if id is out of the arena. ids that don't
+ * name a live array aren't caught here, but whatever they turn up stays
+ * inside the arena. freed arrays have length 0.
+ */
+static inline uint32_t *
+arena_array(const struct arena *a,
+            uint32_t id,
+            uint32_t *len)
+{
+    const uint32_t *hdr = NULL;
+
+    if (__builtin_expect(id < ARENA_HDR || id >= a->top, 0)) {
+        return NULL;
+    }
+    hdr = a->base + id - ARENA_HDR;
+    if (__builtin_expect(hdr[1] > a->top - id, 0)) {
+        return NULL;
+    }
+    *len = hdr[1];
+    return a->base + id;
+}
+
+#endif /* VMDEUX_ARENA_H */
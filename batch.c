@@ -0,0 +1,520 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * batch mode. jobs are dealt out to the workers in contiguous runs, each
+ * worker works through its own run from the front and, once that is gone,
+ * steals from the back of the others'. every job gets its own machine, but
+ * all the jobs of a program run from the one copy of its image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "vmdeux.h"
+#include "batch.h"
+#include "sched.h"
+#include "util.h"
+
+/* manifest lines longer than this are an error */
+#define BATCH_LINE_MAX 4096
+
+typedef struct bimg_t {
+    char *path;
+    vmdeux_image_t *img;
+} bimg_t;
+
+/* console of a job */
+typedef struct jobio_t {
+    int ifd;
+    int ofd;
+} jobio_t;
+
+typedef struct job_t {
+    /* index into the image table */
+    size_t img;
+    char *in;
+    char *out;
+    /* set up by job_start */
+    vmdeux_t *vm;
+    jobio_t io;
+    /* filled in by whoever runs it */
+    int rc;
+    int worker;
+    bool stolen;
+    uint64_t icount;
+    uint64_t peak_words;
+    double secs;
+} job_t;
+
+/* one worker's share of the jobs: indices [head, tail) */
+typedef struct deque_t {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} deque_t;
+
+typedef struct batch_t {
+    const struct batch_opts *opts;
+    bimg_t *imgs;
+    size_t nimgs;
+    job_t *jobs;
+    size_t njobs;
+    /* one deque per worker */
+    deque_t *dq;
+    int nworkers;
+} batch_t;
+
+typedef struct worker_t {
+    batch_t *b;
+    int id;
+} worker_t;
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+job_read(void *ctx,
+         void *buf,
+         size_t len)
+{
+    return (long)read(((jobio_t *)ctx)->ifd, buf, len);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+job_write(void *ctx,
+          const void *buf,
+          size_t len)
+{
+    return (long)write(((jobio_t *)ctx)->ofd, buf, len);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static const char *
+dev_path(const char *path)
+{
+    return (0 == strcmp(path, "-")) ? "/dev/null" : path;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* image table index for path, opening it the first time it comes up */
+static int
+get_image(batch_t *b,
+          const char *path,
+          size_t *idx)
+{
+    bimg_t *tmp = NULL;
+    size_t i;
+    int rc = VMDEUX_SUCCESS;
+
+    for (i = 0; i < b->nimgs; ++i) {
+        if (0 == strcmp(b->imgs[i].path, path)) {
+            *idx = i;
+            return VMDEUX_SUCCESS;
+        }
+    }
+    if (NULL == (tmp = realloc(b->imgs, (b->nimgs + 1) * sizeof(*tmp)))) {
+        return VMDEUX_ERR_OOR;
+    }
+    b->imgs = tmp;
+    tmp = &b->imgs[b->nimgs];
+    if (NULL == (tmp->path = strdup(path))) {
+        return VMDEUX_ERR_OOR;
+    }
+    if (VMDEUX_SUCCESS != (rc = vmdeux_image_open(&tmp->img, path))) {
+        fprintf(stderr, "can't load %s: %d\n", path, rc);
+        free(tmp->path);
+        return rc;
+    }
+    *idx = b->nimgs++;
+    return VMDEUX_SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+read_manifest(batch_t *b,
+              const char *path)
+{
+    char line[BATCH_LINE_MAX];
+    char img[BATCH_LINE_MAX], in[BATCH_LINE_MAX], out[BATCH_LINE_MAX];
+    char extra;
+    size_t lineno = 0, cap = 0;
+    FILE *f = NULL;
+    int rc = VMDEUX_SUCCESS;
+
+    if (NULL == (f = fopen(path, "r"))) {
+        int err = errno;
+        fprintf(stderr, "can't open %s: %d (%s)\n", path, err, strerror(err));
+        return VMDEUX_ERR_IO;
+    }
+    while (NULL != fgets(line, sizeof(line), f)) {
+        job_t *job = NULL;
+        char *p = line;
+        ++lineno;
+        if (NULL == strchr(line, '\n') && !feof(f)) {
+            fprintf(stderr, "%s:%lu: line too long\n", path,
+                    (unsigned long)lineno);
+            rc = VMDEUX_ERR_INVLD_INPUT;
+            break;
+        }
+        p += strspn(p, " \t");
+        if ('#' == *p || '\n' == *p || '\0' == *p) continue;
+        if (3 != sscanf(p, "%s %s %s %c", img, in, out, &extra)) {
+            fprintf(stderr, "%s:%lu: expected IMAGE INPUT OUTPUT\n", path,
+                    (unsigned long)lineno);
+            rc = VMDEUX_ERR_INVLD_INPUT;
+            break;
+        }
+        if (b->njobs == cap) {
+            job_t *tmp = NULL;
+            cap = (0 == cap) ? 64 : 2 * cap;
+            if (NULL == (tmp = realloc(b->jobs, cap * sizeof(*tmp)))) {
+                rc = VMDEUX_ERR_OOR;
+                break;
+            }
+            b->jobs = tmp;
+        }
+        job = &b->jobs[b->njobs];
+        (void)memset(job, 0, sizeof(*job));
+        job->io.ifd = job->io.ofd = -1;
+        if (VMDEUX_SUCCESS != (rc = get_image(b, img, &job->img))) {
+            break;
+        }
+        if (NULL == (job->in = strdup(in)) ||
+            NULL == (job->out = strdup(out))) {
+            free(job->in);
+            rc = VMDEUX_ERR_OOR;
+            break;
+        }
+        b->njobs++;
+    }
+    if (VMDEUX_SUCCESS == rc && ferror(f)) {
+        rc = VMDEUX_ERR_IO;
+    }
+    fclose(f);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* opens the job's files and gets its machine ready to run */
+static int
+job_start(const batch_t *b,
+          job_t *job,
+          bool nonblock)
+{
+    struct vmdeux_config cfg;
+    int rc = VMDEUX_SUCCESS;
+
+    if (-1 == (job->io.ifd = open(dev_path(job->in),
+                                  O_RDONLY | (nonblock ? O_NONBLOCK : 0)))) {
+        int err = errno;
+        fprintf(stderr, "can't open %s: %d (%s)\n", job->in, err,
+                strerror(err));
+        return VMDEUX_ERR_IO;
+    }
+    if (-1 == (job->io.ofd = open(dev_path(job->out),
+                                  O_WRONLY | O_CREAT | O_TRUNC, 0644))) {
+        int err = errno;
+        fprintf(stderr, "can't open %s: %d (%s)\n", job->out, err,
+                strerror(err));
+        return VMDEUX_ERR_IO;
+    }
+    (void)memset(&cfg, 0, sizeof(cfg));
+    cfg.io.ctx = &job->io;
+    cfg.io.read = job_read;
+    cfg.io.write = job_write;
+    cfg.line_flush = b->opts->line_flush;
+    cfg.max_arrays = b->opts->max_arrays;
+    cfg.max_words = b->opts->max_words;
+    cfg.arena = b->opts->arena;
+    cfg.arena_compact = b->opts->arena_compact;
+    cfg.thp = b->opts->thp;
+    if (VMDEUX_SUCCESS != (rc = vmdeux_create(&job->vm, &cfg))) {
+        return rc;
+    }
+    return vmdeux_load_shared(job->vm, b->imgs[job->img].img);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* settles the job's numbers and tears it down. rc is how it ran. */
+static void
+job_finish(job_t *job,
+           int rc)
+{
+    struct vmdeux_stats st;
+
+    if (NULL != job->vm) {
+        if (0 != vmdeux_flush(job->vm) && VMDEUX_SUCCESS == rc) {
+            rc = VMDEUX_ERR_IO;
+        }
+        vmdeux_stats(job->vm, &st);
+        job->icount = st.icount;
+        job->peak_words = st.peak_words;
+        vmdeux_destroy(job->vm);
+        job->vm = NULL;
+    }
+    if (-1 != job->io.ifd) {
+        close(job->io.ifd);
+    }
+    if (-1 != job->io.ofd && 0 != close(job->io.ofd) && VMDEUX_SUCCESS == rc) {
+        rc = VMDEUX_ERR_IO;
+    }
+    job->io.ifd = job->io.ofd = -1;
+    job->rc = rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+run_job(const batch_t *b,
+        job_t *job)
+{
+    double start = 0.0;
+    int rc = VMDEUX_SUCCESS;
+
+    if (VMDEUX_SUCCESS == (rc = job_start(b, job, false))) {
+        start = now();
+        do {
+            rc = vmdeux_run(job->vm, b->opts->engine, UINT64_MAX);
+        } while (VMDEUX_YIELD == rc);
+        job->secs = now() - start;
+    }
+    job_finish(job, rc);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * runs every job on this thread, quantum instructions at a time. inputs are
+ * non-blocking, so a job waiting on a pipe or a terminal doesn't hold up the
+ * rest.
+ */
+static int
+run_sliced(batch_t *b)
+{
+    struct sched_task *tasks = NULL;
+    /* job behind each task */
+    size_t *map = NULL;
+    size_t i, n = 0;
+    int rc = VMDEUX_SUCCESS;
+
+    if (NULL == (tasks = calloc(b->njobs, sizeof(*tasks))) ||
+        NULL == (map = calloc(b->njobs, sizeof(*map)))) {
+        free(tasks);
+        return VMDEUX_ERR_OOR;
+    }
+    for (i = 0; i < b->njobs; ++i) {
+        job_t *job = &b->jobs[i];
+        if (VMDEUX_SUCCESS != (rc = job_start(b, job, true))) {
+            /* the rest go ahead without it */
+            job_finish(job, rc);
+            continue;
+        }
+        tasks[n].vm = job->vm;
+        tasks[n].fd = job->io.ifd;
+        map[n++] = i;
+    }
+    rc = sched_run(tasks, n, b->opts->engine, b->opts->quantum);
+    for (i = 0; i < n; ++i) {
+        job_t *job = &b->jobs[map[i]];
+        job->secs = tasks[i].secs;
+        job_finish(job, (VMDEUX_SUCCESS == rc) ? tasks[i].rc : rc);
+    }
+    free(tasks);
+    free(map);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* next job for worker id: its own from the front, or someone else's back */
+static job_t *
+next_job(batch_t *b,
+         int id)
+{
+    deque_t *dq = &b->dq[id];
+    job_t *job = NULL;
+    int i;
+
+    (void)pthread_mutex_lock(&dq->lock);
+    if (dq->head != dq->tail) {
+        job = &b->jobs[dq->head++];
+    }
+    (void)pthread_mutex_unlock(&dq->lock);
+    if (NULL != job) {
+        return job;
+    }
+    for (i = 1; i < b->nworkers && NULL == job; ++i) {
+        deque_t *v = &b->dq[(id + i) % b->nworkers];
+        (void)pthread_mutex_lock(&v->lock);
+        if (v->head != v->tail) {
+            job = &b->jobs[--v->tail];
+            job->stolen = true;
+        }
+        (void)pthread_mutex_unlock(&v->lock);
+    }
+    /* jobs are never added, so everybody being empty means we're done */
+    return job;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void *
+worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    job_t *job = NULL;
+
+    while (NULL != (job = next_job(w->b, w->id))) {
+        job->worker = w->id;
+        run_job(w->b, job);
+    }
+    return NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+report(const batch_t *b,
+       double secs)
+{
+    uint64_t icount = 0;
+    size_t i, nfail = 0, nstolen = 0;
+    double busy = 0.0;
+
+    for (i = 0; i < b->njobs; ++i) {
+        const job_t *job = &b->jobs[i];
+        printf("job %lu: %s < %s > %s rc: %d worker: %d%s instructions: "
+               "%"PRIu64" seconds: %.3f MIPS: %.2f peak bytes: %"PRIu64"\n",
+               (unsigned long)i, b->imgs[job->img].path, job->in, job->out,
+               job->rc, job->worker, job->stolen ? " (stolen)" : "",
+               job->icount, job->secs, job->secs > 0.0 ?
+               (double)job->icount / job->secs / 1e6 : 0.0,
+               job->peak_words * 4);
+        icount += job->icount;
+        busy += job->secs;
+        nfail += (VMDEUX_SUCCESS != job->rc);
+        nstolen += job->stolen;
+    }
+    printf("batch: jobs: %lu failed: %lu stolen: %lu images: %lu workers: %d "
+           "quantum: %"PRIu64" engine: %s\n", (unsigned long)b->njobs,
+           (unsigned long)nfail, (unsigned long)nstolen,
+           (unsigned long)b->nimgs, b->nworkers, b->opts->quantum,
+           vmdeux_engine_name(b->opts->engine));
+    printf("batch: instructions: %"PRIu64" seconds: %.3f cpu seconds: %.3f "
+           "MIPS: %.2f jobs/s: %.2f\n", icount, secs, busy,
+           secs > 0.0 ? (double)icount / secs / 1e6 : 0.0,
+           secs > 0.0 ? (double)b->njobs / secs : 0.0);
+    fflush(stdout);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* runs the jobs to completion on a pool of nworkers threads */
+static int
+run_pool(batch_t *b)
+{
+    pthread_t *tids = NULL;
+    worker_t *ws = NULL;
+    size_t i;
+    int n = b->opts->nworkers, nstarted = 0, rc = VMDEUX_SUCCESS;
+
+    /* idle workers would only get in the way of the stealing */
+    if ((size_t)n > b->njobs) {
+        n = (0 == b->njobs) ? 1 : (int)b->njobs;
+    }
+    b->nworkers = n;
+    if (NULL == (b->dq = calloc((size_t)n, sizeof(*b->dq))) ||
+        NULL == (tids = calloc((size_t)n, sizeof(*tids))) ||
+        NULL == (ws = calloc((size_t)n, sizeof(*ws)))) {
+        rc = VMDEUX_ERR_OOR;
+        goto out;
+    }
+    for (i = 0; i < (size_t)n; ++i) {
+        (void)pthread_mutex_init(&b->dq[i].lock, NULL);
+        b->dq[i].head = b->njobs * i / (size_t)n;
+        b->dq[i].tail = b->njobs * (i + 1) / (size_t)n;
+        ws[i].b = b;
+        ws[i].id = (int)i;
+    }
+    for (nstarted = 0; nstarted < n; ++nstarted) {
+        if (0 != pthread_create(&tids[nstarted], NULL, worker,
+                                &ws[nstarted])) {
+            break;
+        }
+    }
+    /* whoever did start steals the rest */
+    if (0 == nstarted) {
+        (void)worker(&ws[0]);
+    }
+    for (i = 0; i < (size_t)nstarted; ++i) {
+        (void)pthread_join(tids[i], NULL);
+    }
+    for (i = 0; i < (size_t)n; ++i) {
+        (void)pthread_mutex_destroy(&b->dq[i].lock);
+    }
+
+out:
+    free(b->dq);
+    b->dq = NULL;
+    free(tids);
+    free(ws);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+batch_run(const char *manifest,
+          const struct batch_opts *opts)
+{
+    batch_t b;
+    size_t i;
+    int rc = VMDEUX_SUCCESS;
+    double start = 0.0;
+
+    (void)memset(&b, 0, sizeof(b));
+    b.opts = opts;
+    b.nworkers = 1;
+    if (VMDEUX_SUCCESS != (rc = read_manifest(&b, manifest))) {
+        goto out;
+    }
+    start = now();
+    rc = (0 != opts->quantum) ? run_sliced(&b) : run_pool(&b);
+    if (VMDEUX_SUCCESS != rc) {
+        goto out;
+    }
+    report(&b, now() - start);
+    for (i = 0; i < b.njobs; ++i) {
+        if (VMDEUX_SUCCESS != b.jobs[i].rc) {
+            rc = VMDEUX_ERR;
+        }
+    }
+
+out:
+    for (i = 0; i < b.njobs; ++i) {
+        free(b.jobs[i].in);
+        free(b.jobs[i].out);
+    }
+    for (i = 0; i < b.nimgs; ++i) {
+        vmdeux_image_close(b.imgs[i].img);
+        free(b.imgs[i].path);
+    }
+    free(b.jobs);
+    free(b.imgs);
+    return rc;
+}
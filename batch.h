@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_BATCH_H
+#define VMDEUX_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* how batch_run runs each job */
+struct batch_opts {
+    /* see vmdeux_engine */
+    int engine;
+    /* worker threads */
+    int nworkers;
+    /*
+     * if not 0, every job runs on the calling thread instead, taking turns
+     * quantum instructions at a time (see sched_run)
+     */
+    uint64_t quantum;
+    /* flush job output after every newline */
+    bool line_flush;
+    /* per-job allocation caps (see vmdeux_config) */
+    uint64_t max_arrays;
+    uint64_t max_words;
+    /* see vmdeux_config */
+    bool arena;
+    bool arena_compact;
+    bool thp;
+};
+
+/*
+ * runs every job in manifest and prints a line per job and a summary on
+ * stdout. a manifest line is "IMAGE INPUT OUTPUT", where - means /dev/null.
+ * blank lines and lines starting with # are skipped. returns VMDEUX_SUCCESS
+ * if every job ran to completion.
+ */
+int batch_run(const char *manifest, const struct batch_opts *opts);
+
+#endif /* VMDEUX_BATCH_H */
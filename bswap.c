@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "bswap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BSWAP_X86 1
+#endif
+
+typedef void (*bswap_fn_t)(uint32_t *dst, const uint32_t *src, size_t n);
+
+/* set once by pick. the cpu doesn't change under us. */
+static pthread_once_t picked = PTHREAD_ONCE_INIT;
+static bswap_fn_t bswap_fn = NULL;
+static const char *bswap_name = NULL;
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+bswap_scalar(uint32_t *dst,
+             const uint32_t *src,
+             size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        dst[i] = __builtin_bswap32(src[i]);
+    }
+}
+
+#ifdef BSWAP_X86
+/* ////////////////////////////////////////////////////////////////////////// */
+__attribute__((target("ssse3")))
+static void
+bswap_ssse3(uint32_t *dst,
+            const uint32_t *src,
+            size_t n)
+{
+    const __m128i m = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                    11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, m));
+    }
+    bswap_scalar(dst + i, src + i, n - i);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+__attribute__((target("avx2")))
+static void
+bswap_avx2(uint32_t *dst,
+           const uint32_t *src,
+           size_t n)
+{
+    const __m256i m = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                       11, 10, 9, 8, 15, 14, 13, 12,
+                                       3, 2, 1, 0, 7, 6, 5, 4,
+                                       11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, m));
+    }
+    bswap_scalar(dst + i, src + i, n - i);
+}
+#endif /* BSWAP_X86 */
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+pick(void)
+{
+    bswap_fn = bswap_scalar;
+    bswap_name = "scalar";
+#ifdef BSWAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        bswap_fn = bswap_avx2;
+        bswap_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("ssse3")) {
+        bswap_fn = bswap_ssse3;
+        bswap_name = "ssse3";
+    }
+#endif
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+bswap32_copy(uint32_t *dst,
+             const uint32_t *src,
+             size_t n)
+{
+    (void)pthread_once(&picked, pick);
+    bswap_fn(dst, src, n);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+const char *
+bswap32_impl(void)
+{
+    (void)pthread_once(&picked, pick);
+    return bswap_name;
+}
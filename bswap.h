@@ -0,0 +1,33 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_BSWAP_H
+#define VMDEUX_BSWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * copies n words from src to dst, reversing the bytes of each. dst and src
+ * may be the same buffer. the widest kernel the cpu supports is picked on
+ * first use.
+ */
+void bswap32_copy(uint32_t *dst, const uint32_t *src, size_t n);
+/* name of the kernel bswap32_copy uses */
+const char *bswap32_impl(void);
+
+#endif /* VMDEUX_BSWAP_H */
@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ckpt.h"
+#include "util.h"
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+put(int fd,
+    const void *buf,
+    size_t len)
+{
+    const char *p = buf;
+
+    while (0 != len) {
+        ssize_t n = write(fd, p, len);
+        if (0 > n) {
+            if (EINTR == errno) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* writes job out as one record, and makes sure it's on disk */
+static int
+put_rec(int fd,
+        const struct ckpt_job *job)
+{
+    static const char zeros[8];
+    const ckpt_rec_t *rec = &job->rec;
+    size_t lists = (size_t)rec->narrays * sizeof(*job->ents) +
+                   ((size_t)rec->nfreed + rec->nfree) * sizeof(uint32_t) +
+                   rec->ilen;
+    size_t pad = ckpt_lists_len(rec) - lists;
+    uint64_t words = 0, h = FNV_INIT;
+    ckpt_rec_t hdr = *rec;
+    ckpt_end_t end;
+    uint32_t i;
+
+    for (i = 0; i < rec->narrays; ++i) {
+        words += job->ents[i].nwords;
+    }
+    hdr.magic = CKPT_REC_MAGIC;
+    hdr.body = ckpt_lists_len(rec) + ckpt_align(words * sizeof(uint32_t));
+    h = fnv_bytes(h, &hdr, sizeof(hdr));
+    h = fnv_bytes(h, job->ents, rec->narrays * sizeof(*job->ents));
+    h = fnv_bytes(h, job->ids,
+                  ((size_t)rec->nfreed + rec->nfree) * sizeof(uint32_t));
+    h = fnv_bytes(h, job->input, rec->ilen);
+    h = fnv_bytes(h, zeros, pad);
+    if (0 != put(fd, &hdr, sizeof(hdr)) ||
+        0 != put(fd, job->ents, rec->narrays * sizeof(*job->ents)) ||
+        0 != put(fd, job->ids,
+                 ((size_t)rec->nfreed + rec->nfree) * sizeof(uint32_t)) ||
+        0 != put(fd, job->input, rec->ilen) ||
+        0 != put(fd, zeros, pad)) {
+        return -1;
+    }
+    for (i = 0; i < rec->narrays; ++i) {
+        size_t n = job->ents[i].nwords;
+        h = fnv_words(h, job->data[i], n);
+        if (0 != put(fd, job->data[i], n * sizeof(uint32_t))) {
+            return -1;
+        }
+    }
+    (void)memset(&end, 0, sizeof(end));
+    end.magic = CKPT_END_MAGIC;
+    end.hash = h;
+    if (0 != put(fd, zeros, ckpt_align(words * 4) - words * 4) ||
+        0 != put(fd, &end, sizeof(end))) {
+        return -1;
+    }
+    return fdatasync(fd);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a base goes into a new log that replaces the old one once it is complete */
+static int
+put_base(struct ckpt *c,
+         const struct ckpt_job *job)
+{
+    ckpt_file_t hdr;
+    char *tmp = NULL;
+    int fd = -1, err = 0;
+
+    if (NULL == (tmp = malloc(strlen(c->path) + sizeof(".tmp")))) {
+        return -1;
+    }
+    (void)sprintf(tmp, "%s.tmp", c->path);
+    (void)memset(&hdr, 0, sizeof(hdr));
+    (void)memcpy(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic));
+    hdr.endian = CKPT_ENDIAN;
+    hdr.version = CKPT_VERSION;
+    if (-1 == (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) ||
+        0 != put(fd, &hdr, sizeof(hdr)) || 0 != put_rec(fd, job) ||
+        0 != rename(tmp, c->path)) {
+        err = errno;
+        if (-1 != fd) {
+            (void)close(fd);
+            (void)unlink(tmp);
+        }
+        free(tmp);
+        errno = err;
+        return -1;
+    }
+    free(tmp);
+    if (-1 != c->fd) {
+        (void)close(c->fd);
+    }
+    c->fd = fd;
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void *
+writer(void *arg)
+{
+    struct ckpt *c = (struct ckpt *)arg;
+
+    (void)pthread_mutex_lock(&c->lock);
+    while (true) {
+        struct ckpt_job *job = &c->job;
+        int rc = 0;
+
+        if (!c->busy) {
+            if (c->stop) break;
+            (void)pthread_cond_wait(&c->more, &c->lock);
+            continue;
+        }
+        (void)pthread_mutex_unlock(&c->lock);
+        /* the machine leaves the payloads alone until we say we're done */
+        if (0 == c->err) {
+            rc = job->rec.base ? put_base(c, job) :
+                 (-1 == c->fd) ? (errno = EBADF, -1) : put_rec(c->fd, job);
+        }
+        free(job->ents);
+        free(job->data);
+        free(job->ids);
+        free(job->input);
+        (void)pthread_mutex_lock(&c->lock);
+        if (0 != rc && 0 == c->err) {
+            c->err = errno;
+        }
+        c->busy = false;
+        (void)pthread_cond_signal(&c->done);
+    }
+    (void)pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct ckpt *
+ckpt_create(const char *path)
+{
+    struct ckpt *c = NULL;
+    int err = 0;
+
+    if (NULL == (c = calloc(1, sizeof(*c)))) {
+        return NULL;
+    }
+    if (NULL == (c->path = strdup(path))) {
+        free(c);
+        return NULL;
+    }
+    c->fd = -1;
+    (void)pthread_mutex_init(&c->lock, NULL);
+    (void)pthread_cond_init(&c->more, NULL);
+    (void)pthread_cond_init(&c->done, NULL);
+    if (0 != (err = pthread_create(&c->writer, NULL, writer, c))) {
+        (void)pthread_cond_destroy(&c->more);
+        (void)pthread_cond_destroy(&c->done);
+        (void)pthread_mutex_destroy(&c->lock);
+        free(c->path);
+        free(c);
+        errno = err;
+        return NULL;
+    }
+    return c;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+ckpt_wait(struct ckpt *c)
+{
+    int err = 0;
+
+    (void)pthread_mutex_lock(&c->lock);
+    while (c->busy) {
+        (void)pthread_cond_wait(&c->done, &c->lock);
+    }
+    err = c->err;
+    (void)pthread_mutex_unlock(&c->lock);
+    if (0 != err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+ckpt_submit(struct ckpt *c,
+            const struct ckpt_job *job)
+{
+    (void)pthread_mutex_lock(&c->lock);
+    c->job = *job;
+    c->busy = true;
+    (void)pthread_cond_signal(&c->more);
+    (void)pthread_mutex_unlock(&c->lock);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+ckpt_destroy(struct ckpt *c)
+{
+    int rc = 0;
+
+    if (NULL == c) return 0;
+    rc = ckpt_wait(c);
+    (void)pthread_mutex_lock(&c->lock);
+    c->stop = true;
+    (void)pthread_cond_signal(&c->more);
+    (void)pthread_mutex_unlock(&c->lock);
+    (void)pthread_join(c->writer, NULL);
+    if (-1 != c->fd && 0 != close(c->fd)) {
+        rc = -1;
+    }
+    (void)pthread_cond_destroy(&c->more);
+    (void)pthread_cond_destroy(&c->done);
+    (void)pthread_mutex_destroy(&c->lock);
+    free(c->path);
+    free(c);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+ckpt_next(const void *map,
+          size_t len,
+          size_t *off,
+          const ckpt_rec_t **rec)
+{
+    const char *base = map;
+    const ckpt_file_t *fhdr = map;
+    const ckpt_rec_t *r = NULL;
+    const ckpt_arr_t *ents = NULL;
+    ckpt_end_t end;
+    uint64_t words = 0, h = FNV_INIT;
+    size_t at, lists;
+    uint32_t i;
+
+    if (len < sizeof(*fhdr) ||
+        0 != memcmp(fhdr->magic, CKPT_MAGIC, sizeof(fhdr->magic)) ||
+        CKPT_ENDIAN != fhdr->endian || CKPT_VERSION != fhdr->version) {
+        return -1;
+    }
+    at = (0 == *off) ? sizeof(*fhdr) : *off;
+    if (0 == *off) *off = at;
+    /* anything short of a whole record is a write that didn't finish */
+    if (len - at < sizeof(*r)) return 0;
+    r = (const ckpt_rec_t *)(base + at);
+    if (CKPT_REC_MAGIC != r->magic || r->body > len - at - sizeof(*r) ||
+        len - at - sizeof(*r) - r->body < sizeof(end)) {
+        return 0;
+    }
+    lists = ckpt_lists_len(r);
+    if (lists > r->body) return 0;
+    ents = (const ckpt_arr_t *)(r + 1);
+    for (i = 0; i < r->narrays; ++i) {
+        words += ents[i].nwords;
+    }
+    if (lists + ckpt_align(words * sizeof(uint32_t)) != r->body) return 0;
+    h = fnv_bytes(h, r, sizeof(*r) + lists);
+    h = fnv_words(h, (const uint32_t *)((const char *)(r + 1) + lists),
+                  (size_t)words);
+    (void)memcpy(&end, base + at + sizeof(*r) + r->body, sizeof(end));
+    if (CKPT_END_MAGIC != end.magic || h != end.hash) return 0;
+    *rec = r;
+    *off = at + sizeof(*r) + r->body + sizeof(end);
+    return 1;
+}
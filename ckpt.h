@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_CKPT_H
+#define VMDEUX_CKPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * incremental checkpoint log: a ckpt_file_t, then records. the first record
+ * is a base with every array the machine had. each one after it only has
+ * what changed since the record before: arrays written, allocated or
+ * replaced, in full, and the ids freed. every record also has the
+ * registers, the recycled ids and the input read ahead. a record counts once
+ * its trailer is there and its hash checks out, so a log cut short by a crash
+ * restores to the last complete record.
+ *
+ * a record is a ckpt_rec_t, then narrays ckpt_arr_t, nfreed freed ids, nfree
+ * recycled ids (bottom of the stack first), ilen bytes of input, padding to
+ * 8 bytes, the payloads in entry order, padding to 8 bytes and a ckpt_end_t.
+ * everything is in host byte order, so payloads are used in place on
+ * restore, like snapshot payloads.
+ *
+ * a new base starts a new log, written next to the old one and renamed over
+ * it once complete. deltas are appended.
+ */
+#define CKPT_MAGIC     "vmdeuxCK"
+#define CKPT_VERSION   1
+#define CKPT_ENDIAN    0x01020304U
+#define CKPT_REC_MAGIC 0x52504B43U
+#define CKPT_END_MAGIC 0x444E4543U
+
+typedef struct ckpt_file_t {
+    char magic[8];
+    /* CKPT_ENDIAN as written by the host */
+    uint32_t endian;
+    uint32_t version;
+} ckpt_file_t;
+
+typedef struct ckpt_rec_t {
+    uint32_t magic;
+    /* 1 for a base, 0 for a delta */
+    uint32_t base;
+    uint32_t mr[8];
+    uint32_t pc;
+    /* lowest id never handed out */
+    uint32_t next_id;
+    uint64_t icount;
+    uint32_t narrays;
+    uint32_t nfreed;
+    uint32_t nfree;
+    uint32_t ilen;
+    /* bytes from the end of this header to the trailer */
+    uint64_t body;
+} ckpt_rec_t;
+
+typedef struct ckpt_arr_t {
+    uint32_t id;
+    uint32_t nwords;
+} ckpt_arr_t;
+
+typedef struct ckpt_end_t {
+    uint32_t magic;
+    uint32_t pad;
+    /*
+     * fnv-1a of the header and lists a byte at a time, then of the payloads
+     * a word at a time
+     */
+    uint64_t hash;
+} ckpt_end_t;
+
+/* a record for the writer. the lists are malloc'd and become the writer's. */
+struct ckpt_job {
+    ckpt_rec_t rec;
+    ckpt_arr_t *ents;
+    /* payload of each entry. they must stay as they are until ckpt_wait. */
+    const uint32_t **data;
+    /* the freed ids, then the recycled ones */
+    uint32_t *ids;
+    unsigned char *input;
+};
+
+struct ckpt {
+    char *path;
+    /* the log being appended to. -1 before the first base. */
+    int fd;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    /* a job is in, and the writer is done with it */
+    pthread_cond_t more;
+    pthread_cond_t done;
+    struct ckpt_job job;
+    bool busy;
+    bool stop;
+    /* errno of the first failure, 0 if none. nothing is written after it. */
+    int err;
+};
+
+/* starts a writer for the log at path. NULL on failure, with errno set. */
+struct ckpt *ckpt_create(const char *path);
+/* waits for the writer to finish. -1 if anything failed, with errno set. */
+int ckpt_destroy(struct ckpt *c);
+/*
+ * waits until the writer is done with the last job, so its payloads can
+ * change again. -1 if a write failed, with errno set.
+ */
+int ckpt_wait(struct ckpt *c);
+/* hands job to the writer. call ckpt_wait first. */
+void ckpt_submit(struct ckpt *c, const struct ckpt_job *job);
+/*
+ * steps through the complete records of a mapped log. *off starts at 0 and
+ * is left at the end of the last complete record. returns 1 and the record,
+ * 0 at the end, -1 if map isn't a log this host can read.
+ */
+int ckpt_next(const void *map, size_t len, size_t *off, const ckpt_rec_t **rec);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline size_t
+ckpt_align(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* bytes of a record's lists, from the end of its header to the payloads */
+static inline size_t
+ckpt_lists_len(const ckpt_rec_t *rec)
+{
+    return ckpt_align((size_t)rec->narrays * sizeof(ckpt_arr_t) +
+                      ((size_t)rec->nfreed + rec->nfree) * sizeof(uint32_t) +
+                      rec->ilen);
+}
+
+#endif /* VMDEUX_CKPT_H */
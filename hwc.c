@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * perf_event_open counters around a run, to tell dispatch mispredicts from
+ * cache misses. each counter is opened on its own, so the ones the machine
+ * has still count when others don't, and the kernel may multiplex them, in
+ * which case the totals are scaled by how long each one actually ran.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "hwc.h"
+
+#define CACHE_READ_MISS(c)                                                     \
+    ((c) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                                \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[HWC_N] = {
+    {"cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1d-misses",    PERF_TYPE_HW_CACHE,
+                      CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc-misses",    PERF_TYPE_HW_CACHE,
+                      CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)}
+};
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+hwc_open(struct hwc *h)
+{
+    int i, n = 0;
+
+    (void)memset(h, 0, sizeof(*h));
+    for (i = 0; i < HWC_N; ++i) {
+        struct perf_event_attr attr;
+
+        (void)memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        /* what perf_event_paranoid 2 lets anybody have */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        h->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (-1 == h->fd[i]) {
+            if (0 == h->err) h->err = errno;
+            continue;
+        }
+        n++;
+    }
+    return n;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+hwc_close(struct hwc *h)
+{
+    int i;
+
+    for (i = 0; i < HWC_N; ++i) {
+        if (-1 != h->fd[i]) (void)close(h->fd[i]);
+        h->fd[i] = -1;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+hwc_start(struct hwc *h)
+{
+    int i;
+
+    for (i = 0; i < HWC_N; ++i) {
+        if (-1 == h->fd[i]) continue;
+        (void)ioctl(h->fd[i], PERF_EVENT_IOC_RESET, 0);
+        (void)ioctl(h->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+hwc_stop(struct hwc *h)
+{
+    int i;
+
+    for (i = 0; i < HWC_N; ++i) {
+        /* value, time enabled, time running */
+        uint64_t v[3];
+
+        if (-1 == h->fd[i]) continue;
+        (void)ioctl(h->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (sizeof(v) != read(h->fd[i], v, sizeof(v))) {
+            (void)close(h->fd[i]);
+            h->fd[i] = -1;
+            continue;
+        }
+        h->val[i] = v[0];
+        h->scaled[i] = v[2] < v[1];
+        if (h->scaled[i] && 0 != v[2]) {
+            h->val[i] = (uint64_t)((double)v[0] * (double)v[1] /
+                                   (double)v[2]);
+        }
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+hwc_report(const struct hwc *h,
+           FILE *f,
+           uint64_t icount)
+{
+    int i, n = 0;
+
+    if (EACCES == h->err || EPERM == h->err) {
+        fprintf(f, "hwcounters: not permitted (see "
+                "/proc/sys/kernel/perf_event_paranoid)\n");
+    }
+    else if (ENOENT == h->err || EOPNOTSUPP == h->err) {
+        fprintf(f, "hwcounters: this cpu (or vm) doesn't count some events\n");
+    }
+    else if (0 != h->err) {
+        fprintf(f, "hwcounters: perf_event_open failure: %d (%s)\n", h->err,
+                strerror(h->err));
+    }
+    fprintf(f, "hwcounters:");
+    for (i = 0; i < HWC_N; ++i) {
+        if (-1 == h->fd[i]) {
+            fprintf(f, " %s: n/a", events[i].name);
+            continue;
+        }
+        fprintf(f, " %s: %"PRIu64"%s", events[i].name, h->val[i],
+                h->scaled[i] ? " (scaled)" : "");
+        n++;
+    }
+    if (-1 != h->fd[0] && -1 != h->fd[1] && 0 != h->val[0]) {
+        fprintf(f, " ipc: %.2f", (double)h->val[1] / (double)h->val[0]);
+    }
+    fprintf(f, "\n");
+    if (0 == icount || 0 == n) return;
+    fprintf(f, "hwcounters: per guest instruction:");
+    for (i = 0; i < HWC_N; ++i) {
+        if (-1 == h->fd[i]) continue;
+        fprintf(f, " %s: %.4f", events[i].name,
+                (double)h->val[i] / (double)icount);
+    }
+    fprintf(f, "\n");
+}
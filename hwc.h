@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_HWC_H
+#define VMDEUX_HWC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* cycles, instructions, branch misses, l1d read misses, llc read misses */
+#define HWC_N 5
+
+/* hardware performance counters for the calling thread, user time only */
+struct hwc {
+    /* -1 where the counter couldn't be had */
+    int fd[HWC_N];
+    /* what they read at hwc_stop, scaled up if they had to take turns */
+    uint64_t val[HWC_N];
+    bool scaled[HWC_N];
+    /* errno from the first counter that couldn't be opened, 0 if none */
+    int err;
+};
+
+/*
+ * opens what counters it can, stopped. returns how many that is. the rest
+ * (or all of them, without a pmu or with perf_event_paranoid too high) just
+ * show up as n/a.
+ */
+int hwc_open(struct hwc *h);
+void hwc_close(struct hwc *h);
+void hwc_start(struct hwc *h);
+void hwc_stop(struct hwc *h);
+/* totals, and per guest instruction over icount of them */
+void hwc_report(const struct hwc *h, FILE *f, uint64_t icount);
+
+#endif /* VMDEUX_HWC_H */
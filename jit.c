@@ -0,0 +1,745 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * x86-64 basic block translator.
+ *
+ * A block starts at whatever pc we were asked to run and ends at the first
+ * loadprog, halt or invalid instruction (or after JIT_MAX_BLOCK
+ * instructions). Guest registers stay in jit_frame.mr, which translated code
+ * addresses off rbx. Array 0 reads and writes are inlined. Everything else
+ * calls back into the runtime through jit_rt. So do writes while array 0
+ * shares its payload with another array (zwlen is 0 then).
+ *
+ * A loadprog from array 0 looks its target up in the block table and jumps
+ * straight there when a translation exists. That is the only form of block
+ * linking, so dropping a translation is just clearing its table slot.
+ *
+ * Translated code leaves through a common exit stub with one of the JX_
+ * codes in eax. Before it does, it stores pc and the instructions it retired
+ * into the frame. Linked jumps also leave once icount reaches ilimit, so the
+ * runtime gets control back even from a loop that never exits its blocks.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/* most instructions in a block */
+#define JIT_MAX_BLOCK 512
+/* worst case bytes emitted per instruction (aupd), with room to spare */
+#define JIT_MAX_INSN_BYTES 192
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK * JIT_MAX_INSN_BYTES + 64)
+/* size of the code cache. it is flushed wholesale when it fills up. */
+#define JIT_CODE_SIZE (32 << 20)
+
+/* exit codes from translated code. JIT_HALT and JIT_INTERP pass through. */
+enum {
+    /* carry on at frame pc */
+    JX_CONTINUE = 0,
+    /* loadprog replaced the zero array */
+    JX_RELOAD = JIT_YIELD + 1
+};
+
+/* x86 registers by encoding */
+enum {
+    EAX = 0, ECX, EDX, EBX, ESP, EBP, ESI, EDI
+};
+
+/* condition codes for jcc */
+enum {
+    CC_B = 0x2, CC_AE = 0x3, CC_Z = 0x4, CC_NZ = 0x5
+};
+
+#define F_MR(i)  ((int)(offsetof(struct jit_frame, mr) + 4 * (i)))
+#define F_PC     ((int)offsetof(struct jit_frame, pc))
+#define F_ZLEN   ((int)offsetof(struct jit_frame, zlen))
+#define F_ZWLEN  ((int)offsetof(struct jit_frame, zwlen))
+#define F_IC     ((int)offsetof(struct jit_frame, icount))
+#define F_ILIM   ((int)offsetof(struct jit_frame, ilimit))
+#define F_ZBASE  ((int)offsetof(struct jit_frame, zbase))
+#define F_BLOCKS ((int)offsetof(struct jit_frame, blocks))
+#define F_CMAP   ((int)offsetof(struct jit_frame, cmap))
+#define F_CTX    ((int)offsetof(struct jit_frame, ctx))
+
+/* everything is addressed with an 8-bit displacement */
+_Static_assert(sizeof(struct jit_frame) < 128, "jit_frame too big");
+
+/* a translated range of the zero array */
+struct jblock {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct jit {
+    struct jit_rt rt;
+    struct jit_frame *f;
+    /* code cache */
+    uint8_t *mem;
+    /* next free byte in the code cache */
+    uint8_t *cur;
+    /* first byte after the stubs */
+    uint8_t *code;
+    int (*enter)(struct jit_frame *f, void *code);
+    uint8_t *exit_stub;
+    /* live translations */
+    struct jblock *blk;
+    size_t nblk;
+    size_t blk_cap;
+    /* stats */
+    uint64_t ntranslated;
+    uint64_t ninsns;
+    uint64_t nflushes;
+    uint64_t ninvalidated;
+};
+
+#if defined(__x86_64__)
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+e8(struct jit *j,
+   uint8_t b)
+{
+    *j->cur++ = b;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+e32(struct jit *j,
+    uint32_t v)
+{
+    (void)memcpy(j->cur, &v, sizeof(v));
+    j->cur += sizeof(v);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+e64(struct jit *j,
+    uint64_t v)
+{
+    (void)memcpy(j->cur, &v, sizeof(v));
+    j->cur += sizeof(v);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* op reg, [rbx + d]. op1 < 0 for single byte opcodes. */
+static inline void
+e_rm(struct jit *j,
+     int rexw,
+     uint8_t op0,
+     int op1,
+     int reg,
+     int d)
+{
+    if (rexw) e8(j, 0x48);
+    e8(j, op0);
+    if (op1 >= 0) e8(j, (uint8_t)op1);
+    /* mod 01 (disp8), rm rbx */
+    e8(j, (uint8_t)(0x40 | (reg << 3) | EBX));
+    e8(j, (uint8_t)d);
+}
+
+#define LD(j, r, d)    e_rm((j), 0, 0x8B, -1, (r), (d))
+#define ST(j, r, d)    e_rm((j), 0, 0x89, -1, (r), (d))
+#define ADD(j, r, d)   e_rm((j), 0, 0x03, -1, (r), (d))
+#define AND(j, r, d)   e_rm((j), 0, 0x23, -1, (r), (d))
+#define CMP(j, r, d)   e_rm((j), 0, 0x3B, -1, (r), (d))
+#define IMUL(j, r, d)  e_rm((j), 0, 0x0F, 0xAF, (r), (d))
+#define LD64(j, r, d)  e_rm((j), 1, 0x8B, -1, (r), (d))
+#define CMP64(j, r, d) e_rm((j), 1, 0x3B, -1, (r), (d))
+#define LEA64(j, r, d) e_rm((j), 1, 0x8D, -1, (r), (d))
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* test r, r */
+static inline void
+e_test(struct jit *j,
+       int r)
+{
+    e8(j, 0x85);
+    e8(j, (uint8_t)(0xC0 | (r << 3) | r));
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+e_call(struct jit *j,
+       const void *fn)
+{
+    /* mov rax, imm64; call rax */
+    e8(j, 0x48);
+    e8(j, 0xB8);
+    e64(j, (uint64_t)(uintptr_t)fn);
+    e8(j, 0xFF);
+    e8(j, 0xD0);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* jcc rel32. returns where the displacement goes for patch_here. */
+static inline uint8_t *
+e_jcc(struct jit *j,
+      int cc)
+{
+    e8(j, 0x0F);
+    e8(j, (uint8_t)(0x80 | cc));
+    e32(j, 0);
+    return j->cur - 4;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline uint8_t *
+e_jmp(struct jit *j)
+{
+    e8(j, 0xE9);
+    e32(j, 0);
+    return j->cur - 4;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+patch_to(uint8_t *at,
+         const uint8_t *target)
+{
+    int32_t rel = (int32_t)(target - (at + 4));
+    (void)memcpy(at, &rel, sizeof(rel));
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+patch_here(struct jit *j,
+           uint8_t *at)
+{
+    patch_to(at, j->cur);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* add qword [rbx + icount], n */
+static inline void
+e_retire(struct jit *j,
+         uint32_t n)
+{
+    e8(j, 0x48);
+    e8(j, 0x81);
+    e8(j, 0x40 | EBX);
+    e8(j, F_IC);
+    e32(j, n);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* leaves translated code at pc after retiring n instructions */
+static void
+e_exit(struct jit *j,
+       uint32_t pc,
+       uint32_t n,
+       int code)
+{
+    /* mov dword [rbx + pc], imm32 */
+    e8(j, 0xC7);
+    e8(j, 0x40 | EBX);
+    e8(j, F_PC);
+    e32(j, pc);
+    if (0 != n) {
+        e_retire(j, n);
+    }
+    /* mov eax, code */
+    e8(j, 0xB8);
+    e32(j, (uint32_t)code);
+    patch_to(e_jmp(j), j->exit_stub);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+emit_stubs(struct jit *j)
+{
+    j->cur = j->mem;
+    /* int enter(struct jit_frame *f, void *code) */
+    j->enter = (int (*)(struct jit_frame *, void *))(void *)j->cur;
+    /* push rbx -- also leaves the stack 16-byte aligned for calls */
+    e8(j, 0x53);
+    /* mov rbx, rdi */
+    e8(j, 0x48); e8(j, 0x89); e8(j, 0xFB);
+    /* jmp rsi */
+    e8(j, 0xFF); e8(j, 0xE6);
+    j->exit_stub = j->cur;
+    /* pop rbx; ret */
+    e8(j, 0x5B);
+    e8(j, 0xC3);
+    j->code = j->cur;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+flush(struct jit *j)
+{
+    struct jit_frame *f = j->f;
+
+    if (NULL != f->blocks) {
+        (void)memset(f->blocks, 0, f->zlen * sizeof(*f->blocks));
+        (void)memset(f->cmap, 0, ((f->zlen + 63) / 64) * sizeof(*f->cmap));
+    }
+    j->nblk = 0;
+    j->cur = j->code;
+    j->nflushes++;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+invalidate(struct jit *j,
+           uint32_t idx)
+{
+    size_t i = 0;
+
+    while (i < j->nblk) {
+        if (j->blk[i].start <= idx && idx <= j->blk[i].end) {
+            j->f->blocks[j->blk[i].start] = NULL;
+            j->blk[i] = j->blk[--j->nblk];
+            j->ninvalidated++;
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * slow path for aupd: other arrays, out of bounds, and zero array words that
+ * are part of a translation. returns 0 to carry on, 1 if translated code was
+ * overwritten and the block has to be left, 2 on error.
+ */
+static int
+jit_aupd(struct jit_frame *f,
+         uint32_t id,
+         uint32_t idx,
+         uint32_t val)
+{
+    struct jit *j = f->jit;
+
+    if (unlikely(0 != j->rt.aupd(f->ctx, id, idx, val))) {
+        return 2;
+    }
+    if (0 != id) {
+        return 0;
+    }
+    /* the write may have given array 0 a payload of its own */
+    j->rt.zero(f->ctx, &f->zbase, &f->zlen, &f->zwlen);
+    if (f->cmap[idx / 64] & (1ULL << (idx % 64))) {
+        invalidate(j, idx);
+        return 1;
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* emits one instruction. returns false if it ends the block. */
+static bool
+emit_insn(struct jit *j,
+          uint32_t pc,
+          uint32_t k,
+          uint32_t w)
+{
+    int a = (w >> 6) & 7, b = (w >> 3) & 7, c = w & 7;
+    uint8_t *p0 = NULL, *p1 = NULL, *p2 = NULL, *p3 = NULL;
+
+    switch (w >> 28) {
+        case 0:
+            /* cmov */
+            LD(j, EAX, F_MR(c));
+            e_test(j, EAX);
+            /* jz over the next two instructions */
+            e8(j, 0x74);
+            e8(j, 6);
+            LD(j, EAX, F_MR(b));
+            ST(j, EAX, F_MR(a));
+            return true;
+        case 1:
+            /* aidx */
+            LD(j, ESI, F_MR(b));
+            LD(j, EDX, F_MR(c));
+            e_test(j, ESI);
+            p0 = e_jcc(j, CC_NZ);
+            CMP(j, EDX, F_ZLEN);
+            p1 = e_jcc(j, CC_AE);
+            LD64(j, EAX, F_ZBASE);
+            /* mov eax, [rax + rdx * 4] */
+            e8(j, 0x8B); e8(j, 0x04); e8(j, 0x90);
+            ST(j, EAX, F_MR(a));
+            p2 = e_jmp(j);
+            patch_here(j, p0);
+            patch_here(j, p1);
+            LD64(j, EDI, F_CTX);
+            LEA64(j, ECX, F_MR(a));
+            e_call(j, (const void *)j->rt.aidx);
+            e_test(j, EAX);
+            p3 = e_jcc(j, CC_Z);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p2);
+            patch_here(j, p3);
+            return true;
+        case 2:
+            /* aupd */
+            LD(j, ESI, F_MR(a));
+            LD(j, EDX, F_MR(b));
+            LD(j, ECX, F_MR(c));
+            e_test(j, ESI);
+            p0 = e_jcc(j, CC_NZ);
+            CMP(j, EDX, F_ZWLEN);
+            p1 = e_jcc(j, CC_AE);
+            LD64(j, EAX, F_CMAP);
+            /* bt qword [rax], rdx */
+            e8(j, 0x48); e8(j, 0x0F); e8(j, 0xA3); e8(j, 0x10);
+            p2 = e_jcc(j, CC_B);
+            LD64(j, EAX, F_ZBASE);
+            /* mov [rax + rdx * 4], ecx */
+            e8(j, 0x89); e8(j, 0x0C); e8(j, 0x90);
+            p3 = e_jmp(j);
+            patch_here(j, p0);
+            patch_here(j, p1);
+            patch_here(j, p2);
+            /* mov rdi, rbx */
+            e8(j, 0x48); e8(j, 0x89); e8(j, 0xDF);
+            e_call(j, (const void *)jit_aupd);
+            e_test(j, EAX);
+            p0 = e_jcc(j, CC_Z);
+            /* cmp eax, 1 */
+            e8(j, 0x83); e8(j, 0xF8); e8(j, 0x01);
+            p1 = e_jcc(j, CC_NZ);
+            e_exit(j, pc + 1, k + 1, JX_CONTINUE);
+            patch_here(j, p1);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            patch_here(j, p3);
+            return true;
+        case 3:
+            LD(j, EAX, F_MR(b));
+            ADD(j, EAX, F_MR(c));
+            ST(j, EAX, F_MR(a));
+            return true;
+        case 4:
+            LD(j, EAX, F_MR(b));
+            IMUL(j, EAX, F_MR(c));
+            ST(j, EAX, F_MR(a));
+            return true;
+        case 5:
+            LD(j, ECX, F_MR(c));
+            e_test(j, ECX);
+            p0 = e_jcc(j, CC_NZ);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            LD(j, EAX, F_MR(b));
+            /* xor edx, edx; div ecx */
+            e8(j, 0x31); e8(j, 0xD2);
+            e8(j, 0xF7); e8(j, 0xF1);
+            ST(j, EAX, F_MR(a));
+            return true;
+        case 6:
+            LD(j, EAX, F_MR(b));
+            AND(j, EAX, F_MR(c));
+            /* not eax */
+            e8(j, 0xF7); e8(j, 0xD0);
+            ST(j, EAX, F_MR(a));
+            return true;
+        case 7:
+            /* halt retires, but pc stays put */
+            e_exit(j, pc, k + 1, JIT_HALT);
+            return false;
+        case 8:
+            LD64(j, EDI, F_CTX);
+            LD(j, ESI, F_MR(c));
+            LEA64(j, EDX, F_MR(b));
+            e_call(j, (const void *)j->rt.alloc);
+            e_test(j, EAX);
+            p0 = e_jcc(j, CC_Z);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            return true;
+        case 9:
+            LD64(j, EDI, F_CTX);
+            LD(j, ESI, F_MR(c));
+            e_call(j, (const void *)j->rt.dealloc);
+            e_test(j, EAX);
+            p0 = e_jcc(j, CC_Z);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            return true;
+        case 10:
+            LD64(j, EDI, F_CTX);
+            LD(j, ESI, F_MR(c));
+            e_call(j, (const void *)j->rt.out);
+            return true;
+        case 11:
+            LD64(j, EDI, F_CTX);
+            LEA64(j, ESI, F_MR(c));
+            /* mov edx, k */
+            e8(j, 0xBA);
+            e32(j, k);
+            e_call(j, (const void *)j->rt.in);
+            e_test(j, EAX);
+            p0 = e_jcc(j, CC_Z);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            return true;
+        case 12:
+            LD(j, ESI, F_MR(b));
+            e_test(j, ESI);
+            p0 = e_jcc(j, CC_NZ);
+            /* jump within the zero array: link to the target block */
+            LD(j, EAX, F_MR(c));
+            e_retire(j, k + 1);
+            CMP(j, EAX, F_ZLEN);
+            p1 = e_jcc(j, CC_AE);
+            /* out of budget: let jit_exec see it */
+            LD64(j, EDX, F_IC);
+            CMP64(j, EDX, F_ILIM);
+            p3 = e_jcc(j, CC_AE);
+            LD64(j, EDX, F_BLOCKS);
+            /* mov rdx, [rdx + rax * 8]; test rdx, rdx */
+            e8(j, 0x48); e8(j, 0x8B); e8(j, 0x14); e8(j, 0xC2);
+            e8(j, 0x48); e8(j, 0x85); e8(j, 0xD2);
+            p2 = e_jcc(j, CC_Z);
+            /* jmp rdx */
+            e8(j, 0xFF); e8(j, 0xE2);
+            patch_here(j, p1);
+            patch_here(j, p2);
+            patch_here(j, p3);
+            ST(j, EAX, F_PC);
+            e8(j, 0xB8);
+            e32(j, JX_CONTINUE);
+            patch_to(e_jmp(j), j->exit_stub);
+            /* loadprog from another array */
+            patch_here(j, p0);
+            LD64(j, EDI, F_CTX);
+            e_call(j, (const void *)j->rt.loadprog);
+            e_test(j, EAX);
+            p0 = e_jcc(j, CC_Z);
+            e_exit(j, pc, k, JIT_INTERP);
+            patch_here(j, p0);
+            LD(j, EAX, F_MR(c));
+            ST(j, EAX, F_PC);
+            e_retire(j, k + 1);
+            e8(j, 0xB8);
+            e32(j, JX_RELOAD);
+            patch_to(e_jmp(j), j->exit_stub);
+            return false;
+        case 13:
+            /* mov dword [rbx + mr[a]], imm32 */
+            e8(j, 0xC7);
+            e8(j, 0x40 | EBX);
+            e8(j, (uint8_t)F_MR((w >> 25) & 7));
+            e32(j, w & 0x01FFFFFFU);
+            return true;
+        default:
+            /* let the interpreter complain */
+            e_exit(j, pc, k, JIT_INTERP);
+            return false;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void *
+translate(struct jit *j,
+          uint32_t start)
+{
+    struct jit_frame *f = j->f;
+    uint8_t *code = NULL;
+    uint32_t pc = start, k = 0;
+    bool more = true;
+
+    if ((size_t)(j->mem + JIT_CODE_SIZE - j->cur) < JIT_MAX_BLOCK_BYTES) {
+        flush(j);
+    }
+    if (j->nblk == j->blk_cap) {
+        size_t ncap = (0 == j->blk_cap) ? 1024 : 2 * j->blk_cap;
+        struct jblock *nblk = realloc(j->blk, ncap * sizeof(*nblk));
+        if (NULL == nblk) return NULL;
+        j->blk = nblk;
+        j->blk_cap = ncap;
+    }
+    code = j->cur;
+    while (more) {
+        if (pc >= f->zlen || JIT_MAX_BLOCK == k) {
+            e_exit(j, pc, k, JX_CONTINUE);
+            break;
+        }
+        f->cmap[pc / 64] |= 1ULL << (pc % 64);
+        more = emit_insn(j, pc, k, f->zbase[pc]);
+        ++pc;
+        ++k;
+    }
+    j->blk[j->nblk].start = start;
+    j->blk[j->nblk].end = pc - 1;
+    j->nblk++;
+    f->blocks[start] = code;
+    j->ntranslated++;
+    j->ninsns += k;
+    return code;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct jit *
+jit_create(const struct jit_rt *rt,
+           struct jit_frame *f)
+{
+    struct jit *j = NULL;
+    void *mem = NULL;
+
+    mem = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mem) {
+        return NULL;
+    }
+    if (NULL == (j = calloc(1, sizeof(*j)))) {
+        (void)munmap(mem, JIT_CODE_SIZE);
+        return NULL;
+    }
+    j->rt = *rt;
+    j->f = f;
+    j->mem = mem;
+    f->jit = j;
+    f->blocks = NULL;
+    f->cmap = NULL;
+    f->zlen = 0;
+    emit_stubs(j);
+    return j;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+jit_destroy(struct jit *j)
+{
+    if (NULL == j) return;
+    (void)munmap(j->mem, JIT_CODE_SIZE);
+    free(j->f->blocks);
+    free(j->f->cmap);
+    j->f->blocks = NULL;
+    j->f->cmap = NULL;
+    free(j->blk);
+    free(j);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+jit_reset(struct jit *j)
+{
+    struct jit_frame *f = j->f;
+    uint32_t *base = NULL;
+    uint32_t len = 0, wlen = 0;
+
+    j->rt.zero(f->ctx, &base, &len, &wlen);
+    if (NULL == f->blocks || len != f->zlen) {
+        void **nblocks = NULL;
+        uint64_t *ncmap = NULL;
+        /* always get something back, even for an empty program */
+        if (NULL == (nblocks = realloc(f->blocks, (len + 1) *
+                                       sizeof(*nblocks)))) {
+            return -1;
+        }
+        f->blocks = nblocks;
+        if (NULL == (ncmap = realloc(f->cmap, ((len + 64) / 64) *
+                                     sizeof(*ncmap)))) {
+            return -1;
+        }
+        f->cmap = ncmap;
+    }
+    f->zbase = base;
+    f->zlen = len;
+    f->zwlen = wlen;
+    flush(j);
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+jit_written(struct jit *j,
+            uint32_t idx)
+{
+    struct jit_frame *f = j->f;
+
+    if (idx < f->zlen && (f->cmap[idx / 64] & (1ULL << (idx % 64)))) {
+        invalidate(j, idx);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+jit_exec(struct jit *j)
+{
+    struct jit_frame *f = j->f;
+    void *code = NULL;
+    int rc = JX_CONTINUE;
+
+    while (true) {
+        if (unlikely(f->icount >= f->ilimit)) {
+            return JIT_YIELD;
+        }
+        if (unlikely(f->pc >= f->zlen)) {
+            return JIT_INTERP;
+        }
+        if (unlikely(NULL == (code = f->blocks[f->pc]))) {
+            if (NULL == (code = translate(j, f->pc))) {
+                return JIT_INTERP;
+            }
+        }
+        switch ((rc = j->enter(f, code))) {
+            case JX_CONTINUE:
+                break;
+            case JX_RELOAD:
+                if (0 != jit_reset(j)) {
+                    return -1;
+                }
+                break;
+            default:
+                return rc;
+        }
+    }
+}
+
+#else /* !__x86_64__ */
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct jit *
+jit_create(const struct jit_rt *rt,
+           struct jit_frame *f)
+{
+    (void)rt;
+    (void)f;
+    return NULL;
+}
+
+void jit_destroy(struct jit *j) { (void)j; }
+int jit_reset(struct jit *j) { (void)j; return -1; }
+void jit_written(struct jit *j, uint32_t idx) { (void)j; (void)idx; }
+int jit_exec(struct jit *j) { (void)j; return -1; }
+
+#endif /* __x86_64__ */
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+jit_stats(const struct jit *j,
+          FILE *f)
+{
+    if (NULL == j) return;
+    fprintf(f, "jit: blocks: %"PRIu64" insns: %"PRIu64" flushes: %"PRIu64
+            " invalidated: %"PRIu64"\n", j->ntranslated, j->ninsns,
+            j->nflushes, j->ninvalidated);
+}
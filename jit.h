@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_JIT_H
+#define VMDEUX_JIT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* jit_exec return codes */
+enum {
+    /* the guest halted */
+    JIT_HALT = 1,
+    /* the runtime has to interpret the instruction at pc */
+    JIT_INTERP,
+    /* icount reached ilimit at a jump */
+    JIT_YIELD
+};
+
+/*
+ * machine state shared with translated code. translated code addresses it
+ * off a fixed host register, so the layout is part of the code generator.
+ */
+struct jit_frame {
+    /* machine registers */
+    uint32_t mr[8];
+    /* program counter */
+    uint32_t pc;
+    /* length of the zero array */
+    uint32_t zlen;
+    /* length of the zero array that can be written in place. 0 if shared. */
+    uint32_t zwlen;
+    /* instructions retired */
+    uint64_t icount;
+    /* translated code hands control back at the first jump past this */
+    uint64_t ilimit;
+    /* zero array */
+    uint32_t *zbase;
+    /* translated entry point per zero array index, NULL if none */
+    void **blocks;
+    /* one bit per zero array word that is part of a translation */
+    uint64_t *cmap;
+    /* runtime context passed to jit_rt callbacks */
+    void *ctx;
+    /* owning jit */
+    struct jit *jit;
+};
+
+/*
+ * runtime callbacks. translated code calls these for everything that isn't
+ * plain register arithmetic or an access to the zero array. callbacks that
+ * return int return 0 on success. on failure the faulting instruction is
+ * handed back to the runtime (JIT_INTERP) and nothing after it runs. the
+ * frame's icount only moves at block exits and jumps.
+ */
+struct jit_rt {
+    int (*aidx)(void *ctx, uint32_t id, uint32_t idx, uint32_t *val);
+    int (*aupd)(void *ctx, uint32_t id, uint32_t idx, uint32_t val);
+    int (*alloc)(void *ctx, uint32_t nwords, uint32_t *id);
+    int (*dealloc)(void *ctx, uint32_t id);
+    void (*out)(void *ctx, uint32_t val);
+    /* k is how far into its block the instruction is */
+    int (*in)(void *ctx, uint32_t *val, uint32_t k);
+    int (*loadprog)(void *ctx, uint32_t id);
+    /* current zero array, and how much of it can be written in place */
+    void (*zero)(void *ctx, uint32_t **base, uint32_t *len, uint32_t *wlen);
+};
+
+struct jit;
+
+/* NULL if this host can't run translated code */
+struct jit *jit_create(const struct jit_rt *rt, struct jit_frame *f);
+void jit_destroy(struct jit *j);
+/* picks up a new zero array from the runtime and drops all translations */
+int jit_reset(struct jit *j);
+/* drops translations covering a zero array word written behind our back */
+void jit_written(struct jit *j, uint32_t idx);
+/*
+ * runs translated code from f->pc until it halts, needs the runtime or
+ * retires ilimit instructions. the limit is only checked at jumps.
+ */
+int jit_exec(struct jit *j);
+void jit_stats(const struct jit *j, FILE *f);
+
+#endif /* VMDEUX_JIT_H */
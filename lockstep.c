@@ -0,0 +1,590 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * lockstep differential runs of an engine under test against the switch
+ * engine, which is what the instructions mean.
+ *
+ * engines only stop at jumps, once their instruction count reaches the limit
+ * they were given, so that is where the two machines are compared. the
+ * reference is single-stepped to wherever the engine under test stopped.
+ * nothing can be taken back, so closing in on a difference means running
+ * both machines again from the start, on the same input kept from the first
+ * time round, comparing LOCKSTEP_FAN times as often each time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "lockstep.h"
+#include "vmdeux.h"
+#include "util.h"
+
+/* each rerun compares this many times as often as the last */
+#define LOCKSTEP_FAN 64
+
+/* what differs between the two machines */
+enum {
+    D_REGS = 0x1,
+    D_PC = 0x2,
+    D_ICOUNT = 0x4,
+    D_MEM = 0x8,
+    D_OUT = 0x10,
+    D_STATE = 0x20
+};
+
+/* all of stdin that has been asked for so far. every machine reads this. */
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    bool eof;
+} inlog_t;
+
+/* one machine's console */
+typedef struct {
+    inlog_t *in;
+    /* how far into in this machine has read */
+    size_t pos;
+    /* output goes to stdout as well as into the hash */
+    bool echo;
+    uint64_t out_hash;
+} con_t;
+
+typedef struct {
+    vmdeux_t *vm;
+    con_t con;
+    int engine;
+    /* VMDEUX_YIELD while it can go on, VMDEUX_SUCCESS once it halted */
+    int rc;
+} side_t;
+
+/* the engine under test, then the reference */
+typedef struct {
+    side_t s[2];
+} pair_t;
+
+/* a machine as it was compared */
+typedef struct {
+    struct vmdeux_regs regs;
+    uint64_t mem;
+    uint64_t out;
+    int rc;
+} state_t;
+
+/* the last instruction in a run to do something, or none */
+typedef struct {
+    bool set;
+    uint64_t icount;
+    uint32_t pc;
+    uint32_t w;
+} insn_t;
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+con_read(void *ctx,
+         void *buf,
+         size_t len)
+{
+    con_t *c = ctx;
+    inlog_t *in = c->in;
+    size_t n = 0;
+
+    if (c->pos == in->len && !in->eof) {
+        long got = 0;
+        if (in->len == in->cap) {
+            size_t cap = (0 == in->cap) ? (1 << 16) : 2 * in->cap;
+            unsigned char *tmp = realloc(in->buf, cap);
+            if (NULL == tmp) {
+                errno = ENOMEM;
+                return -1;
+            }
+            in->buf = tmp;
+            in->cap = cap;
+        }
+        got = (long)read(STDIN_FILENO, in->buf + in->len, in->cap - in->len);
+        if (0 > got) return -1;
+        if (0 == got) in->eof = true;
+        in->len += (size_t)got;
+    }
+    n = in->len - c->pos;
+    if (n > len) n = len;
+    (void)memcpy(buf, in->buf + c->pos, n);
+    c->pos += n;
+    return (long)n;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+con_write(void *ctx,
+          const void *buf,
+          size_t len)
+{
+    con_t *c = ctx;
+    long n = (long)len;
+
+    if (c->echo && 0 > (n = (long)write(STDOUT_FILENO, buf, len))) {
+        return -1;
+    }
+    c->out_hash = fnv_bytes(c->out_hash, buf, (size_t)n);
+    return n;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+side_open(side_t *s,
+          const char *path,
+          const struct lockstep_opts *opts,
+          inlog_t *in,
+          int engine,
+          bool echo)
+{
+    struct vmdeux_config cfg;
+    int rc;
+
+    s->con.in = in;
+    s->con.pos = 0;
+    s->con.echo = echo;
+    s->con.out_hash = FNV_INIT;
+    s->engine = engine;
+    s->rc = VMDEUX_YIELD;
+    (void)memset(&cfg, 0, sizeof(cfg));
+    cfg.io.ctx = &s->con;
+    cfg.io.read = con_read;
+    cfg.io.write = con_write;
+    cfg.line_flush = opts->line_flush;
+    cfg.max_arrays = opts->max_arrays;
+    cfg.max_words = opts->max_words;
+    cfg.arena = opts->arena;
+    cfg.arena_compact = opts->arena_compact;
+    cfg.thp = opts->thp;
+    if (VMDEUX_SUCCESS != (rc = vmdeux_create(&s->vm, &cfg))) {
+        s->vm = NULL;
+        return rc;
+    }
+    return vmdeux_load_file(s->vm, path);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+pair_close(pair_t *p)
+{
+    int i;
+
+    for (i = 0; i < 2; ++i) {
+        if (NULL != p->s[i].vm) (void)vmdeux_destroy(p->s[i].vm);
+        p->s[i].vm = NULL;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* only the engine under test's output goes anywhere, and only if echo */
+static int
+pair_open(pair_t *p,
+          const char *path,
+          const struct lockstep_opts *opts,
+          inlog_t *in,
+          bool echo)
+{
+    int rc;
+
+    (void)memset(p, 0, sizeof(*p));
+    if (VMDEUX_SUCCESS != (rc = side_open(&p->s[0], path, opts, in,
+                                          opts->engine, echo)) ||
+        VMDEUX_SUCCESS != (rc = side_open(&p->s[1], path, opts, in,
+                                          vmdeux_engine("switch"), false))) {
+        pair_close(p);
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static uint64_t
+icount_of(const side_t *s)
+{
+    struct vmdeux_regs regs;
+
+    vmdeux_get_regs(s->vm, &regs);
+    return regs.icount;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+side_run(side_t *s,
+         uint64_t limit)
+{
+    if (VMDEUX_YIELD != s->rc) return;
+    s->rc = vmdeux_run(s->vm, s->engine, limit);
+    /* our reads block, so this can't be */
+    if (VMDEUX_WAIT == s->rc) {
+        s->rc = VMDEUX_ERR_IO;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+side_step(side_t *s)
+{
+    int rc;
+
+    if (VMDEUX_YIELD != s->rc) return;
+    rc = vmdeux_step(s->vm);
+    if (VMDEUX_SUCCESS == rc) {
+        s->rc = VMDEUX_YIELD;
+    }
+    else {
+        s->rc = (VMDEUX_HALT == rc) ? VMDEUX_SUCCESS : rc;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a limit that stops an engine at the first jump step or more from cur */
+static uint64_t
+limit_from(uint64_t cur,
+           uint64_t step)
+{
+    if (UINT64_MAX - cur < step) {
+        return UINT64_MAX;
+    }
+    return cur + step - 1;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* runs both machines to the same instruction count, at or past limit */
+static void
+advance(pair_t *p,
+        uint64_t limit)
+{
+    side_t *t = &p->s[0], *r = &p->s[1];
+    int round;
+
+    side_run(t, limit);
+    side_run(r, limit);
+    /* they normally stop at the same jump. if not, one catches up. */
+    for (round = 0; round < 4; ++round) {
+        uint64_t ti = icount_of(t), ri = icount_of(r);
+        if (ti == ri) return;
+        if (ri < ti) {
+            while (VMDEUX_YIELD == r->rc && icount_of(r) < ti) {
+                side_step(r);
+            }
+        }
+        else if (VMDEUX_YIELD == t->rc) {
+            side_run(t, ri - 1);
+        }
+        else {
+            return;
+        }
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+snap(side_t *s,
+     state_t *st)
+{
+    vmdeux_get_regs(s->vm, &st->regs);
+    /* output still in the machine's buffer isn't in the hash yet */
+    (void)vmdeux_flush(s->vm);
+    st->mem = vmdeux_hash(s->vm);
+    st->out = s->con.out_hash;
+    st->rc = s->rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static unsigned
+compare(pair_t *p,
+        state_t *a,
+        state_t *b)
+{
+    unsigned d = 0;
+
+    snap(&p->s[0], a);
+    snap(&p->s[1], b);
+    if (0 != memcmp(a->regs.mr, b->regs.mr, sizeof(a->regs.mr))) d |= D_REGS;
+    if (a->regs.pc != b->regs.pc) d |= D_PC;
+    if (a->regs.icount != b->regs.icount) d |= D_ICOUNT;
+    if (a->mem != b->mem) d |= D_MEM;
+    if (a->out != b->out) d |= D_OUT;
+    if (a->rc != b->rc) d |= D_STATE;
+    return d;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a fresh pair run to where an earlier one agreed at instruction lo */
+static int
+rerun(pair_t *p,
+      const char *path,
+      const struct lockstep_opts *opts,
+      inlog_t *in,
+      uint64_t lo)
+{
+    state_t a, b;
+    int rc;
+
+    if (VMDEUX_SUCCESS != (rc = pair_open(p, path, opts, in, false))) {
+        return rc;
+    }
+    while (VMDEUX_YIELD == p->s[0].rc && icount_of(&p->s[0]) < lo) {
+        advance(p, lo - 1);
+    }
+    if (0 != compare(p, &a, &b) || lo != a.regs.icount) {
+        fprintf(stderr, "lockstep: a rerun didn't get back to instruction "
+                "%"PRIu64". is the engine deterministic?\n", lo);
+        pair_close(p);
+        return VMDEUX_ERR;
+    }
+    return VMDEUX_SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static const char *
+state_name(int rc)
+{
+    if (VMDEUX_YIELD == rc) return "running";
+    if (VMDEUX_SUCCESS == rc) return "halted";
+    return "failed";
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* register an instruction writes, -1 if none */
+static int
+dest_reg(uint32_t w)
+{
+    switch (w >> 28) {
+        case 0: case 1: case 3: case 4: case 5: case 6:
+            return (int)((w >> 6) & 7);
+        case 8:
+            return (int)((w >> 3) & 7);
+        case 11:
+            return (int)(w & 7);
+        case 13:
+            return (int)((w >> 25) & 7);
+        default:
+            return -1;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+note(insn_t *i,
+     const struct vmdeux_regs *at,
+     uint32_t w,
+     bool first)
+{
+    if (first && i->set) return;
+    i->set = true;
+    i->icount = at->icount;
+    i->pc = at->pc;
+    i->w = w;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * runs a fresh pair to lo, where they last agreed, and the engine under test
+ * on to its next stop. the reference steps through the same instructions,
+ * printing each.
+ */
+static int
+report(const char *path,
+       const struct lockstep_opts *opts,
+       inlog_t *in,
+       uint64_t lo)
+{
+    const char *name = vmdeux_engine_name(opts->engine);
+    /* last writer of each register, first to touch arrays and output */
+    insn_t reg[8], mem, out, last, *culprit = NULL;
+    pair_t p;
+    state_t a, b;
+    char text[64];
+    uint64_t hi = 0;
+    unsigned d = 0;
+    int rc, i;
+
+    if (VMDEUX_SUCCESS != (rc = rerun(&p, path, opts, in, lo))) {
+        return rc;
+    }
+    (void)memset(reg, 0, sizeof(reg));
+    (void)memset(&mem, 0, sizeof(mem));
+    (void)memset(&out, 0, sizeof(out));
+    (void)memset(&last, 0, sizeof(last));
+    side_run(&p.s[0], lo);
+    hi = icount_of(&p.s[0]);
+    fprintf(stderr, "lockstep: %s and switch agree up to instruction %"PRIu64
+            " and differ at %"PRIu64". switch ran:\n", name, lo, hi);
+    fprintf(stderr, "%12s %8s %8s %-28s %s\n", "icount", "pc", "insn", "op",
+            "result");
+    while (VMDEUX_YIELD == p.s[1].rc &&
+           (icount_of(&p.s[1]) < hi || !last.set)) {
+        struct vmdeux_regs at, after;
+        const uint32_t *z = NULL;
+        size_t nz = 0;
+        uint32_t w = 0;
+        int r;
+
+        vmdeux_get_regs(p.s[1].vm, &at);
+        z = vmdeux_zero(p.s[1].vm, &nz);
+        if (at.pc < nz) w = z[at.pc];
+        side_step(&p.s[1]);
+        vmdeux_get_regs(p.s[1].vm, &after);
+        (void)vmdeux_disasm(w, text, sizeof(text));
+        fprintf(stderr, "%12"PRIu64" %08"PRIx32" %08"PRIx32" %-28s ",
+                at.icount, at.pc, w, text);
+        if (0 <= (r = dest_reg(w))) {
+            fprintf(stderr, "r%d=%08"PRIx32"\n", r, after.mr[r]);
+            note(&reg[r], &at, w, false);
+        }
+        else {
+            fprintf(stderr, "%s\n", (VMDEUX_YIELD == p.s[1].rc) ? "" :
+                    state_name(p.s[1].rc));
+        }
+        if (2 == w >> 28 || 8 == w >> 28 || 9 == w >> 28 || 12 == w >> 28) {
+            note(&mem, &at, w, true);
+        }
+        if (10 == w >> 28) note(&out, &at, w, true);
+        note(&last, &at, w, false);
+    }
+    d = compare(&p, &a, &b);
+    fprintf(stderr, "then %s differs from switch in:\n", name);
+    for (i = 0; i < 8; ++i) {
+        if (a.regs.mr[i] == b.regs.mr[i]) continue;
+        fprintf(stderr, "  r%d: %08"PRIx32" against %08"PRIx32"\n", i,
+                a.regs.mr[i], b.regs.mr[i]);
+        /* the earliest final write of a register that came out wrong */
+        if (reg[i].set && (NULL == culprit || reg[i].icount < culprit->icount)) {
+            culprit = &reg[i];
+        }
+    }
+    if (d & D_PC) {
+        fprintf(stderr, "  pc: %08"PRIx32" against %08"PRIx32"\n",
+                a.regs.pc, b.regs.pc);
+    }
+    if (d & D_ICOUNT) {
+        fprintf(stderr, "  instruction count: %"PRIu64" against %"PRIu64"\n",
+                a.regs.icount, b.regs.icount);
+    }
+    if (d & D_MEM) fprintf(stderr, "  array contents\n");
+    if (d & D_OUT) fprintf(stderr, "  output\n");
+    if (d & D_STATE) {
+        fprintf(stderr, "  state: %s against %s\n", state_name(a.rc),
+                state_name(b.rc));
+    }
+    if (0 == d) {
+        fprintf(stderr, "  nothing this time. is the engine deterministic?\n");
+    }
+    if (NULL == culprit && (d & D_MEM) && mem.set) culprit = &mem;
+    if (NULL == culprit && (d & D_OUT) && out.set) culprit = &out;
+    if (NULL == culprit && last.set) culprit = &last;
+    if (NULL != culprit) {
+        (void)vmdeux_disasm(culprit->w, text, sizeof(text));
+        fprintf(stderr, "first diverging instruction: %"PRIu64" at pc %08"
+                PRIx32": %08"PRIx32" %s\n", culprit->icount, culprit->pc,
+                culprit->w, text);
+    }
+    pair_close(&p);
+    return VMDEUX_ERR;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * they agreed at lo and not step instructions or so later. closes in on the
+ * first straight-line run where they stop agreeing and reports it.
+ */
+static int
+narrow(const char *path,
+       const struct lockstep_opts *opts,
+       inlog_t *in,
+       uint64_t lo,
+       uint64_t step)
+{
+    while (1 < step) {
+        pair_t p;
+        state_t a, b;
+        bool found = false;
+        int rc;
+
+        step = (step + LOCKSTEP_FAN - 1) / LOCKSTEP_FAN;
+        if (VMDEUX_SUCCESS != (rc = rerun(&p, path, opts, in, lo))) {
+            return rc;
+        }
+        while (VMDEUX_YIELD == p.s[0].rc || VMDEUX_YIELD == p.s[1].rc) {
+            advance(&p, limit_from(lo, step));
+            if (0 != compare(&p, &a, &b)) {
+                found = true;
+                break;
+            }
+            lo = a.regs.icount;
+        }
+        pair_close(&p);
+        if (!found) {
+            fprintf(stderr, "lockstep: a rerun ran to the end without a "
+                    "difference. is the engine deterministic?\n");
+            return VMDEUX_ERR;
+        }
+    }
+    return report(path, opts, in, lo);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+lockstep_run(const char *path,
+             const struct lockstep_opts *opts)
+{
+    const char *name = vmdeux_engine_name(opts->engine);
+    inlog_t in;
+    pair_t p;
+    state_t a, b;
+    uint64_t lo = 0, ncompared = 0;
+    unsigned d = 0;
+    int rc;
+
+    if (NULL == name || 0 == opts->every) {
+        return VMDEUX_ERR_INVLD_INPUT;
+    }
+    (void)memset(&in, 0, sizeof(in));
+    if (VMDEUX_SUCCESS != (rc = pair_open(&p, path, opts, &in, true))) {
+        free(in.buf);
+        return rc;
+    }
+    while (true) {
+        advance(&p, limit_from(lo, opts->every));
+        ncompared++;
+        if (0 != (d = compare(&p, &a, &b))) break;
+        lo = a.regs.icount;
+        if (VMDEUX_YIELD != a.rc) break;
+    }
+    pair_close(&p);
+    if (0 == d) {
+        fprintf(stderr, "lockstep: %s and switch agree: %"PRIu64" instructions,"
+                " %"PRIu64" comparisons, both %s\n", name, lo, ncompared,
+                state_name(a.rc));
+        rc = a.rc;
+    }
+    else {
+        fprintf(stderr, "lockstep: %s and switch differ between instructions "
+                "%"PRIu64" and %"PRIu64". narrowing it down.\n", name, lo,
+                a.regs.icount);
+        rc = narrow(path, opts, &in, lo, opts->every);
+    }
+    free(in.buf);
+    return rc;
+}
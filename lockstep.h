@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_LOCKSTEP_H
+#define VMDEUX_LOCKSTEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* how lockstep_run sets up its machines */
+struct lockstep_opts {
+    /* engine under test. the reference is always the switch engine. */
+    int engine;
+    /* instructions between comparisons */
+    uint64_t every;
+    /* flush output after every newline */
+    bool line_flush;
+    /* see vmdeux_config. both machines get the same. */
+    uint64_t max_arrays;
+    uint64_t max_words;
+    bool arena;
+    bool arena_compact;
+    bool thp;
+};
+
+/*
+ * runs the program in path on the engine under test and on the switch engine
+ * side by side, on the same input from stdin. the machine under test's
+ * output goes to stdout. every opts->every instructions the two are compared:
+ * registers, pc, instruction count, a hash of every array and a hash of the
+ * output so far. on the first difference the run is repeated with closer and
+ * closer comparisons until it is down to one straight-line run of
+ * instructions. that run is printed on stderr, decoded, with what differed
+ * after it. returns VMDEUX_SUCCESS if the two agreed all the way to the end,
+ * VMDEUX_ERR if they didn't, and whatever else went wrong otherwise.
+ */
+int lockstep_run(const char *path, const struct lockstep_opts *opts);
+
+#endif /* VMDEUX_LOCKSTEP_H */
@@ -0,0 +1,1010 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* the vmdeux command. everything it runs goes through libvmdeux. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "vmdeux.h"
+#include "batch.h"
+#include "lockstep.h"
+#include "hwc.h"
+#include "util.h"
+
+#define PACKAGE     "vmdeux"
+#define PACKAGE_VER "0.2"
+
+#define WARN_PREFIX "-["PACKAGE" WARNING]- "
+
+/* long options without a short one */
+enum {
+    OPT_MAX_ARRAYS = 256,
+    OPT_MAX_MEM,
+    OPT_ARENA,
+    OPT_THP,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_TRACE,
+    OPT_TRACE_LEN,
+    OPT_TRACE_STREAM,
+    OPT_TRACE_DECODE,
+    OPT_EMIT_C,
+    OPT_LOCKSTEP,
+    OPT_HWCOUNTERS,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_EVERY
+};
+
+/* command line options */
+typedef struct opts_t {
+    /* path to application image */
+    const char *exe;
+    /* print allocator statistics at exit */
+    bool pool_stats;
+    /* print an opcode and hot pc profile at exit */
+    bool profile;
+    /* write a pre-swapped copy of exe here instead of running it */
+    const char *convert;
+    /* write a C translation of exe here instead of running it */
+    const char *emit_c;
+    /* where snapshots go. NULL if they are off. */
+    const char *snapshot;
+    /* snapshot and stop once this many instructions retired. 0 if unset. */
+    uint64_t snapshot_at;
+    /* checkpoint log. NULL if off. */
+    const char *checkpoint;
+    /* checkpoint every this many instructions, or seconds if ck_secs */
+    uint64_t checkpoint_every;
+    bool ck_secs;
+    /* prometheus metrics file. NULL if off. */
+    const char *metrics;
+    /* seconds between metrics file updates */
+    unsigned metrics_every;
+    /* print instruction count and rate at exit */
+    bool timing;
+    /* count cycles, cache misses and so on around the run */
+    bool hwcounters;
+    /* flush output after every newline */
+    bool line_flush;
+    /* see vmdeux_engine */
+    int engine;
+    /* run the jobs in this manifest instead of exe. NULL if unset. */
+    const char *batch;
+    /* batch worker threads */
+    int jobs;
+    /* run batch jobs by turns on one thread, this many instructions each */
+    uint64_t quantum;
+    /* guest allocation caps (see vmdeux_config). 0 if unset. */
+    uint64_t max_arrays;
+    uint64_t max_words;
+    /* arena backend, and whether it compacts */
+    bool arena;
+    bool arena_compact;
+    /* transparent huge pages for big arrays */
+    bool thp;
+    /* input log to write, and input log to read instead of stdin */
+    const char *record;
+    const char *replay;
+    /* execution trace file. NULL if not tracing. */
+    const char *trace;
+    /* instructions the trace keeps */
+    uint64_t trace_len;
+    /* write the whole trace as it goes instead of the end of it on demand */
+    bool trace_stream;
+    /* print this trace file instead of running anything */
+    const char *trace_decode;
+    /*
+     * if not 0, run the engine against the switch engine, comparing them
+     * every this many instructions
+     */
+    uint64_t lockstep;
+} opts_t;
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* machine the signal handlers poke at */
+static vmdeux_t *sig_vm = NULL;
+/* a snapshot was asked for */
+static volatile sig_atomic_t sig_snapshot = 0;
+/* a statistics dump was asked for */
+static volatile sig_atomic_t sig_stats = 0;
+/* SIGALRMs so far. the interval timer goes off every tick seconds. */
+static volatile sig_atomic_t sig_ticks = 0;
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* records the request and gets the engine to a safe point to serve it */
+static void
+on_signal(int signo)
+{
+    switch (signo) {
+        case SIGUSR1:
+            sig_stats = 1;
+            break;
+        case SIGUSR2:
+            sig_snapshot = 1;
+            break;
+        case SIGALRM:
+            sig_ticks++;
+            break;
+        default:
+            return;
+    }
+    if (NULL != sig_vm) {
+        vmdeux_interrupt(sig_vm);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+set_handler(int signo,
+            void (*fn)(int))
+{
+    struct sigaction sa;
+
+    (void)memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = fn;
+    /* don't turn a slow guest read into an i/o error */
+    sa.sa_flags = SA_RESTART;
+    (void)sigemptyset(&sa.sa_mask);
+    (void)sigaction(signo, &sa, NULL);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static unsigned
+gcd(unsigned a,
+    unsigned b)
+{
+    while (0 != b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* true if a job every secs seconds came due between tick from and tick to */
+static inline bool
+due(unsigned from,
+    unsigned to,
+    unsigned tick,
+    uint64_t secs)
+{
+    return (uint64_t)to * tick / secs != (uint64_t)from * tick / secs;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+dump_stats(const vmdeux_t *vm,
+           FILE *f,
+           double secs)
+{
+    struct vmdeux_stats st;
+
+    vmdeux_stats(vm, &st);
+    fprintf(f, "stats: seconds: %.3f instructions: %"PRIu64" live arrays: "
+            "%"PRIu64" live words: %"PRIu64" loadprogs: %"PRIu64" io bytes "
+            "in: %"PRIu64" out: %"PRIu64"\n", secs, st.icount,
+            st.live_arrays, st.live_words, st.nloadprog, st.in_bytes,
+            st.out_bytes);
+    fflush(f);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+mem_summary(const vmdeux_t *vm,
+            const opts_t *opts,
+            FILE *f)
+{
+    struct vmdeux_stats st;
+
+    vmdeux_stats(vm, &st);
+    fprintf(f, "memory: live arrays: %"PRIu64" bytes: %"PRIu64" peak arrays: "
+            "%"PRIu64" bytes: %"PRIu64" limit arrays: %"PRIu64" bytes: "
+            "%"PRIu64" refused: %"PRIu64"\n", st.live_arrays,
+            st.live_words * 4, st.peak_arrays, st.peak_words * 4,
+            opts->max_arrays, opts->max_words * 4, st.nlimited);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a byte count with an optional k, m or g (powers of 1024) */
+static int
+parse_size(const char *str,
+           uint64_t *val)
+{
+    char *end = NULL;
+    unsigned shift = 0;
+    uint64_t v;
+
+    errno = 0;
+    v = strtoull(str, &end, 0);
+    if (0 != errno || end == str) {
+        return -1;
+    }
+    switch (*end) {
+        case 'k': case 'K': shift = 10; ++end; break;
+        case 'm': case 'M': shift = 20; ++end; break;
+        case 'g': case 'G': shift = 30; ++end; break;
+        default: break;
+    }
+    if ('\0' != *end || v > (UINT64_MAX >> shift)) {
+        return -1;
+    }
+    *val = v << shift;
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * writes the counters to path in prometheus text format. like snapshots, the
+ * file is written to the side and renamed into place, so a scraper never sees
+ * half of it.
+ */
+static int
+write_metrics(const vmdeux_t *vm,
+              const char *path,
+              double secs)
+{
+    static const struct {
+        const char *name;
+        const char *type;
+        const char *help;
+    } m[] = {
+        {"vmdeux_run_seconds", "gauge", "Seconds spent running the guest."},
+        {"vmdeux_instructions_total", "counter", "Instructions retired."},
+        {"vmdeux_live_arrays", "gauge",
+         "Allocated arrays, not counting array 0."},
+        {"vmdeux_live_words", "gauge",
+         "Words held by allocated arrays, not counting array 0."},
+        {"vmdeux_peak_words", "gauge",
+         "Most words ever held by allocated arrays."},
+        {"vmdeux_refused_allocations_total", "counter",
+         "Allocations refused because of --max-mem or --max-arrays."},
+        {"vmdeux_zero_array_words", "gauge", "Length of array 0."},
+        {"vmdeux_loadprog_total", "counter",
+         "Loadprogs that replaced array 0."},
+        {"vmdeux_io_in_bytes_total", "counter", "Bytes read by the guest."},
+        {"vmdeux_io_out_bytes_total", "counter",
+         "Bytes written by the guest."}
+    };
+    struct vmdeux_stats st;
+    double v[sizeof(m) / sizeof(m[0])];
+    char *tmp = NULL;
+    FILE *f = NULL;
+    size_t i;
+    int rc = VMDEUX_SUCCESS;
+
+    vmdeux_stats(vm, &st);
+    v[0] = secs;
+    v[1] = (double)st.icount;
+    v[2] = (double)st.live_arrays;
+    v[3] = (double)st.live_words;
+    v[4] = (double)st.peak_words;
+    v[5] = (double)st.nlimited;
+    v[6] = (double)st.zero_words;
+    v[7] = (double)st.nloadprog;
+    v[8] = (double)st.in_bytes;
+    v[9] = (double)st.out_bytes;
+
+    if (NULL == (tmp = malloc(strlen(path) + sizeof(".tmp")))) {
+        return VMDEUX_ERR_OOR;
+    }
+    (void)sprintf(tmp, "%s.tmp", path);
+    if (NULL == (f = fopen(tmp, "w"))) {
+        rc = VMDEUX_ERR_IO;
+        goto out;
+    }
+    for (i = 0; i < sizeof(m) / sizeof(m[0]); ++i) {
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n", m[i].name,
+                m[i].help, m[i].name, m[i].type, m[i].name, v[i]);
+    }
+    if (0 != fclose(f) || 0 != rename(tmp, path)) {
+        rc = VMDEUX_ERR_IO;
+    }
+out:
+    if (VMDEUX_SUCCESS != rc) {
+        int err = errno;
+        fprintf(stderr, WARN_PREFIX "can't write %s: %d (%s)\n", path, err,
+                strerror(err));
+        (void)unlink(tmp);
+    }
+    free(tmp);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * runs the machine to completion. the engine comes back with VMDEUX_YIELD
+ * when a snapshot, a checkpoint, a statistics dump or a metrics update is
+ * due. those are done here before it is sent on its way again. it comes back
+ * with VMDEUX_WAIT if stdin is non-blocking and has nothing for it yet. the
+ * time the machine spent stopped for checkpoints goes in ck_secs.
+ */
+static int
+drive(vmdeux_t *vm,
+      const opts_t *opts,
+      double start,
+      unsigned tick,
+      double *ck_secs)
+{
+    uint64_t stop = (0 != opts->snapshot_at) ? opts->snapshot_at : UINT64_MAX;
+    /* instruction count the next checkpoint is due at */
+    uint64_t next_ck = UINT64_MAX;
+    unsigned ticks = (unsigned)sig_ticks;
+    struct vmdeux_stats st;
+    int rc = VMDEUX_SUCCESS;
+
+    vmdeux_stats(vm, &st);
+    if (NULL != opts->checkpoint && !opts->ck_secs) {
+        next_ck = st.icount + opts->checkpoint_every;
+    }
+    while (VMDEUX_YIELD == (rc = vmdeux_run(vm, opts->engine,
+                                            (next_ck < stop) ? next_ck :
+                                            stop)) ||
+           VMDEUX_WAIT == rc) {
+        unsigned now_ticks = (unsigned)sig_ticks;
+        bool waiting = VMDEUX_WAIT == rc;
+        bool at_limit, ck_due;
+        vmdeux_stats(vm, &st);
+        /* a waiting guest is mid-way to its limit, not at it */
+        at_limit = !waiting && st.icount >= stop;
+        /* a run stopped at its limit leaves the log where it stopped */
+        ck_due = st.icount >= next_ck ||
+                 (NULL != opts->checkpoint &&
+                  (at_limit || (opts->ck_secs &&
+                                due(ticks, now_ticks, tick,
+                                    opts->checkpoint_every))));
+        if (sig_stats) {
+            sig_stats = 0;
+            (void)vmdeux_flush(vm);
+            dump_stats(vm, stderr, now() - start);
+            if (NULL != opts->trace && !opts->trace_stream) {
+                (void)vmdeux_trace_dump(vm, opts->trace);
+            }
+        }
+        if (NULL != opts->metrics &&
+            due(ticks, now_ticks, tick, opts->metrics_every)) {
+            /* a failed update is not worth stopping the guest for */
+            (void)write_metrics(vm, opts->metrics, now() - start);
+        }
+        ticks = now_ticks;
+        if (ck_due) {
+            double t = now();
+            if (VMDEUX_SUCCESS != (rc = vmdeux_checkpoint(vm))) {
+                break;
+            }
+            *ck_secs += now() - t;
+            if (!opts->ck_secs) {
+                next_ck = st.icount + opts->checkpoint_every;
+            }
+        }
+        if (sig_snapshot || at_limit) {
+            sig_snapshot = 0;
+            if (VMDEUX_SUCCESS != (rc = vmdeux_snapshot(vm, opts->snapshot))) {
+                break;
+            }
+            if (at_limit) {
+                break;
+            }
+        }
+        /* requests that came in since are served before sleeping */
+        if (waiting && !sig_stats && !sig_snapshot &&
+            (unsigned)sig_ticks == ticks) {
+            struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+            /* a signal gets us out of here, too */
+            (void)poll(&pfd, 1, -1);
+        }
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+go(const opts_t *opts)
+{
+    int rc = VMDEUX_SUCCESS;
+    vmdeux_t *vm = NULL;
+    struct vmdeux_config cfg;
+    struct vmdeux_stats st;
+    struct hwc hwc;
+    double start = 0.0, secs = 0.0, load_secs = 0.0, ck_secs = 0.0;
+    /* interval timer period in seconds, 0 if there is no timer */
+    unsigned tick = 0;
+    /* a restored machine has a head start */
+    uint64_t icount0 = 0;
+
+    (void)memset(&cfg, 0, sizeof(cfg));
+    cfg.line_flush = opts->line_flush;
+    cfg.profile = opts->profile;
+    cfg.max_arrays = opts->max_arrays;
+    cfg.max_words = opts->max_words;
+    cfg.arena = opts->arena;
+    cfg.arena_compact = opts->arena_compact;
+    cfg.thp = opts->thp;
+    cfg.trace_len = (NULL != opts->trace) ? opts->trace_len : 0;
+    if (VMDEUX_SUCCESS != (rc = vmdeux_create(&vm, &cfg))) {
+        fprintf(stderr, "vmdeux_create error: %d\n", rc);
+        return rc;
+    }
+    start = now();
+    if (VMDEUX_SUCCESS != (rc = vmdeux_load_file(vm, opts->exe))) {
+        fprintf(stderr, "load_app error: %d\n", rc);
+        /* rc is set */
+        goto out;
+    }
+    load_secs = now() - start;
+    if (NULL != opts->convert) {
+        rc = vmdeux_write_image(vm, opts->convert);
+        vmdeux_destroy(vm);
+        return rc;
+    }
+    if (NULL != opts->emit_c) {
+        rc = vmdeux_write_c(vm, opts->emit_c, opts->exe);
+        vmdeux_destroy(vm);
+        return rc;
+    }
+    if (NULL != opts->replay &&
+        VMDEUX_SUCCESS != (rc = vmdeux_replay(vm, opts->replay))) {
+        goto out;
+    }
+    if (NULL != opts->record &&
+        VMDEUX_SUCCESS != (rc = vmdeux_record(vm, opts->record))) {
+        goto out;
+    }
+    if (opts->trace_stream &&
+        VMDEUX_SUCCESS != (rc = vmdeux_trace_stream(vm, opts->trace))) {
+        goto out;
+    }
+    if (NULL != opts->checkpoint &&
+        VMDEUX_SUCCESS != (rc = vmdeux_checkpoint_start(vm,
+                                                        opts->checkpoint))) {
+        goto out;
+    }
+    vmdeux_stats(vm, &st);
+    icount0 = st.icount;
+    sig_vm = vm;
+    set_handler(SIGUSR1, on_signal);
+    if (NULL != opts->snapshot) {
+        set_handler(SIGUSR2, on_signal);
+    }
+    /* one timer does for both */
+    if (NULL != opts->metrics) {
+        tick = opts->metrics_every;
+    }
+    if (NULL != opts->checkpoint && opts->ck_secs) {
+        tick = gcd(tick, (unsigned)opts->checkpoint_every);
+    }
+    if (0 != tick) {
+        struct itimerval it;
+        (void)memset(&it, 0, sizeof(it));
+        it.it_interval.tv_sec = it.it_value.tv_sec = tick;
+        set_handler(SIGALRM, on_signal);
+        (void)setitimer(ITIMER_REAL, &it, NULL);
+    }
+    if (opts->hwcounters) {
+        (void)hwc_open(&hwc);
+        hwc_start(&hwc);
+    }
+    start = now();
+    rc = drive(vm, opts, start, tick, &ck_secs);
+    secs = now() - start;
+    if (opts->hwcounters) {
+        hwc_stop(&hwc);
+        vmdeux_stats(vm, &st);
+        hwc_report(&hwc, stderr, st.icount - icount0);
+        hwc_close(&hwc);
+    }
+    if (0 != tick) {
+        struct itimerval it;
+        (void)memset(&it, 0, sizeof(it));
+        (void)setitimer(ITIMER_REAL, &it, NULL);
+    }
+    if (NULL != opts->metrics) {
+        /* the final numbers */
+        (void)write_metrics(vm, opts->metrics, secs);
+    }
+    set_handler(SIGUSR1, SIG_DFL);
+    set_handler(SIGUSR2, SIG_DFL);
+    set_handler(SIGALRM, SIG_DFL);
+    sig_vm = NULL;
+    if (VMDEUX_SUCCESS != rc) {
+        (void)vmdeux_flush(vm);
+        fprintf(stderr, "run error: %d\n", rc);
+        if (NULL != opts->trace && !opts->trace_stream &&
+            VMDEUX_SUCCESS == vmdeux_trace_dump(vm, opts->trace)) {
+            fprintf(stderr, "trace of the last instructions: %s\n",
+                    opts->trace);
+        }
+        goto out;
+    }
+
+out:
+    (void)vmdeux_flush(vm);
+    if (opts->timing) {
+        struct rusage ru;
+        vmdeux_stats(vm, &st);
+        fprintf(stderr, "load: %s: %"PRIu64" bytes seconds: %.6f "
+                "byte swap: %s\n", st.image, st.app_size, load_secs,
+                st.bswap);
+        vmdeux_report(vm, stderr, VMDEUX_REPORT_JIT);
+        fprintf(stderr, "engine: %s instructions: %"PRIu64" seconds: %.3f "
+                "MIPS: %.2f\n", vmdeux_engine_name(opts->engine),
+                st.icount - icount0, secs, secs > 0.0 ?
+                (double)(st.icount - icount0) / secs / 1e6 : 0.0);
+        fprintf(stderr, "loadprog: bytes shared: %"PRIu64" copied on write: "
+                "%"PRIu64" not copied: %"PRIu64"\n", st.cow_shared,
+                st.cow_copied, (st.cow_shared > st.cow_copied) ?
+                st.cow_shared - st.cow_copied : 0);
+        fprintf(stderr, "io: bytes in: %"PRIu64" out: %"PRIu64"\n",
+                st.in_bytes, st.out_bytes);
+        if (NULL != opts->checkpoint) {
+            fprintf(stderr, "checkpoint: bases: %"PRIu64" deltas: %"PRIu64
+                    " bytes: %"PRIu64" pause seconds: %.6f\n", st.ck_bases,
+                    st.ck_deltas, st.ck_words * 4, ck_secs);
+        }
+        if (0 == getrusage(RUSAGE_SELF, &ru)) {
+            fprintf(stderr, "memory: peak rss: %ld KiB\n", ru.ru_maxrss);
+        }
+    }
+    if (opts->timing || 0 != opts->max_arrays || 0 != opts->max_words) {
+        mem_summary(vm, opts, stderr);
+    }
+    vmdeux_report(vm, stderr, (opts->pool_stats ? VMDEUX_REPORT_POOL : 0) |
+                              (opts->profile ? VMDEUX_REPORT_PROFILE : 0));
+    vmdeux_destroy(vm);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+usage(void)
+{
+    printf("usage: %s [OPTION]... APP\n"
+           "  or:  %s [OPTION]... --batch=MANIFEST\n"
+           "APP is a program image, a pre-swapped image or a snapshot.\n"
+           "      --arena[=compact]\n"
+           "                    keep arrays in one arena and use their\n"
+           "                    offsets as ids. compact merges free space and\n"
+           "                    gives it back once half the arena is free.\n"
+           "                    no snapshots.\n"
+           "  -b, --batch=MANIFEST\n"
+           "                    run the jobs in MANIFEST, one per line as\n"
+           "                    IMAGE INPUT OUTPUT (- for /dev/null), and\n"
+           "                    print per-job and total throughput. jobs of\n"
+           "                    the same IMAGE share one copy of it.\n"
+           "      --checkpoint=FILE\n"
+           "                    keep a checkpoint log in FILE: the whole\n"
+           "                    machine, then the arrays that changed since,\n"
+           "                    written in the background. run FILE to pick\n"
+           "                    up from the last complete checkpoint. no\n"
+           "                    arena.\n"
+           "      --checkpoint-every=N|Ns\n"
+           "                    checkpoint at the first jump after every N\n"
+           "                    instructions, or every N seconds (60s)\n"
+           "  -c, --convert=OUT write a pre-swapped copy of APP to OUT and "
+           "exit.\n"
+           "                    pre-swapped images load without a copy.\n"
+           "      --emit-c=OUT  write APP translated to C to OUT and exit.\n"
+           "                    it builds against libvmdeux.a and runs the\n"
+           "                    interpreter once the program changes itself.\n"
+           "  -e, --engine=NAME execution engine: switch (default), threaded,\n"
+           "                    jit, unchecked. unchecked is the switch engine\n"
+           "                    without bounds, id, divisor and opcode checks,\n"
+           "                    for trusted images only.\n"
+           "  -h, --help        print this message\n"
+           "      --hwcounters  print cpu cycles, instructions, branch misses\n"
+           "                    and l1d and llc misses for the run, in total\n"
+           "                    and per guest instruction. counters the\n"
+           "                    system won't give us show up as n/a.\n"
+           "  -j, --jobs=N      batch worker threads (one per online cpu)\n"
+           "  -l, --line-flush  flush output after every newline\n"
+           "      --lockstep[=N]\n"
+           "                    run the engine and the switch engine side by\n"
+           "                    side and compare them every N instructions\n"
+           "                    (1000000). the first difference is narrowed\n"
+           "                    down to a run of instructions and printed.\n"
+           "      --max-arrays=N\n"
+           "                    fail allocations that would leave more than N\n"
+           "                    arrays allocated at once\n"
+           "      --max-mem=BYTES\n"
+           "                    fail allocations that would take the arrays\n"
+           "                    past BYTES (k, m and g suffixes work). the\n"
+           "                    program itself doesn't count.\n"
+           "  -m, --metrics=FILE\n"
+           "                    keep prometheus metrics in FILE\n"
+           "  -M, --metrics-every=SECS\n"
+           "                    update the metrics file this often (10)\n"
+           "  -p, --pool-stats  print allocator statistics at exit\n"
+           "      --record=FILE log the program's input, and when it read it,\n"
+           "                    to FILE\n"
+           "      --replay=FILE take the program's input from a --record log\n"
+           "                    instead of stdin. runs with the same input\n"
+           "                    retire the same instructions, so this makes\n"
+           "                    interactive programs benchmarkable.\n"
+           "  -q, --quantum=N   run the batch on one thread instead, giving\n"
+           "                    each job N instructions at a time. jobs\n"
+           "                    waiting for input (say, on a pipe) step\n"
+           "                    aside until it comes.\n"
+           "  -P, --profile     print opcode counts, hot program counters and\n"
+           "                    array traffic at exit. needs a profiling build\n"
+           "                    (make profile). the jit engine runs threaded.\n"
+           "  -s, --snapshot=FILE\n"
+           "                    write a snapshot to FILE on SIGUSR2. run FILE\n"
+           "                    to pick up where it left off.\n"
+           "  -S, --snapshot-at=N\n"
+           "                    write a snapshot and stop at the first jump\n"
+           "                    after N instructions. needs --snapshot.\n"
+           "                    with --checkpoint, checkpoints there too.\n"
+           "  -t, --timing      print instructions retired and MIPS at exit\n"
+           "      --trace=FILE  keep a trace of the last instructions run\n"
+           "                    and write it to FILE if the program fails or\n"
+           "                    on SIGUSR1. tracing runs the switch engine.\n"
+           "      --trace-len=N the last N instructions (1048576)\n"
+           "      --trace-stream\n"
+           "                    write every instruction to the trace FILE as\n"
+           "                    the program runs instead\n"
+           "      --trace-decode=FILE\n"
+           "                    print a trace and exit\n"
+           "      --thp         ask for transparent huge pages for arrays of\n"
+           "                    2 MiB and up\n"
+           "SIGUSR1 prints run statistics (and writes the --trace ring) without\n"
+           "stopping the program.\n",
+           PACKAGE, PACKAGE);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* ////////////////////////////////////////////////////////////////////////// */
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+main(int argc, char **argv)
+{
+    int c;
+    opts_t opts;
+    static const char *sopts = "b:c:e:hj:lm:M:pPq:s:S:t";
+    static const struct option lopts[] = {
+        {"arena",         optional_argument, NULL, OPT_ARENA},
+        {"batch",         required_argument, NULL, 'b'},
+        {"checkpoint",    required_argument, NULL, OPT_CHECKPOINT},
+        {"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+        {"convert",       required_argument, NULL, 'c'},
+        {"emit-c",        required_argument, NULL, OPT_EMIT_C},
+        {"engine",        required_argument, NULL, 'e'},
+        {"help",          no_argument,       NULL, 'h'},
+        {"hwcounters",    no_argument,       NULL, OPT_HWCOUNTERS},
+        {"jobs",          required_argument, NULL, 'j'},
+        {"line-flush",    no_argument,       NULL, 'l'},
+        {"lockstep",      optional_argument, NULL, OPT_LOCKSTEP},
+        {"max-arrays",    required_argument, NULL, OPT_MAX_ARRAYS},
+        {"max-mem",       required_argument, NULL, OPT_MAX_MEM},
+        {"metrics",       required_argument, NULL, 'm'},
+        {"metrics-every", required_argument, NULL, 'M'},
+        {"pool-stats",    no_argument,       NULL, 'p'},
+        {"profile",       no_argument,       NULL, 'P'},
+        {"quantum",       required_argument, NULL, 'q'},
+        {"record",        required_argument, NULL, OPT_RECORD},
+        {"replay",        required_argument, NULL, OPT_REPLAY},
+        {"snapshot",      required_argument, NULL, 's'},
+        {"snapshot-at",   required_argument, NULL, 'S'},
+        {"thp",           no_argument,       NULL, OPT_THP},
+        {"timing",        no_argument,       NULL, 't'},
+        {"trace",         required_argument, NULL, OPT_TRACE},
+        {"trace-decode",  required_argument, NULL, OPT_TRACE_DECODE},
+        {"trace-len",     required_argument, NULL, OPT_TRACE_LEN},
+        {"trace-stream",  no_argument,       NULL, OPT_TRACE_STREAM},
+        {NULL,            0,                 NULL,   0}
+    };
+
+    (void)memset(&opts, 0, sizeof(opts));
+    opts.metrics_every = 10;
+    opts.checkpoint_every = 60;
+    opts.ck_secs = true;
+    opts.trace_len = 1 << 20;
+    opts.jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (1 > opts.jobs) {
+        opts.jobs = 1;
+    }
+    while (-1 != (c = getopt_long(argc, argv, sopts, lopts, NULL))) {
+        switch (c) {
+            case OPT_ARENA:
+                opts.arena = true;
+                if (NULL != optarg && 0 != strcmp(optarg, "compact")) {
+                    fprintf(stderr, "unknown arena option: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.arena_compact = (NULL != optarg);
+                break;
+            case OPT_THP:
+                opts.thp = true;
+                break;
+            case OPT_HWCOUNTERS:
+                opts.hwcounters = true;
+                break;
+            case OPT_CHECKPOINT:
+                opts.checkpoint = optarg;
+                break;
+            case OPT_CHECKPOINT_EVERY: {
+                char *end = NULL;
+                errno = 0;
+                opts.checkpoint_every = strtoull(optarg, &end, 0);
+                opts.ck_secs = (end != optarg && 's' == *end);
+                if (opts.ck_secs) {
+                    ++end;
+                }
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.checkpoint_every ||
+                    (opts.ck_secs && opts.checkpoint_every > 86400)) {
+                    fprintf(stderr, "bad checkpoint interval: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case OPT_RECORD:
+                opts.record = optarg;
+                break;
+            case OPT_REPLAY:
+                opts.replay = optarg;
+                break;
+            case OPT_TRACE:
+                opts.trace = optarg;
+                break;
+            case OPT_TRACE_LEN: {
+                char *end = NULL;
+                errno = 0;
+                opts.trace_len = strtoull(optarg, &end, 0);
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.trace_len || opts.trace_len > (1ULL << 32)) {
+                    fprintf(stderr, "bad trace length: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case OPT_TRACE_STREAM:
+                opts.trace_stream = true;
+                break;
+            case OPT_TRACE_DECODE:
+                opts.trace_decode = optarg;
+                break;
+            case 'b':
+                opts.batch = optarg;
+                break;
+            case 'c':
+                opts.convert = optarg;
+                break;
+            case OPT_EMIT_C:
+                opts.emit_c = optarg;
+                break;
+            case OPT_LOCKSTEP: {
+                char *end = NULL;
+                opts.lockstep = 1000000;
+                if (NULL == optarg) break;
+                errno = 0;
+                opts.lockstep = strtoull(optarg, &end, 0);
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.lockstep) {
+                    fprintf(stderr, "bad lockstep interval: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'e':
+                if (0 > (opts.engine = vmdeux_engine(optarg))) {
+                    fprintf(stderr, "unknown engine: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'j': {
+                char *end = NULL;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || '\0' != *end || 1 > n || n > 4096) {
+                    fprintf(stderr, "bad job count: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.jobs = (int)n;
+                break;
+            }
+            case 'l':
+                opts.line_flush = true;
+                break;
+            case OPT_MAX_ARRAYS: {
+                char *end = NULL;
+                errno = 0;
+                opts.max_arrays = strtoull(optarg, &end, 0);
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.max_arrays) {
+                    fprintf(stderr, "bad array count: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case OPT_MAX_MEM: {
+                uint64_t bytes = 0;
+                if (0 != parse_size(optarg, &bytes) || bytes < 4) {
+                    fprintf(stderr, "bad memory size: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.max_words = bytes / 4;
+                break;
+            }
+            case 'm':
+                opts.metrics = optarg;
+                break;
+            case 'M': {
+                char *end = NULL;
+                unsigned long secs = strtoul(optarg, &end, 10);
+                if (end == optarg || '\0' != *end || 0 == secs ||
+                    secs > 86400) {
+                    fprintf(stderr, "bad metrics interval: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.metrics_every = (unsigned)secs;
+                break;
+            }
+            case 'p':
+                opts.pool_stats = true;
+                break;
+            case 'P':
+#ifdef VMDEUX_PROFILE
+                opts.profile = true;
+                break;
+#else
+                fprintf(stderr, "--profile needs a profiling build. "
+                        "try make profile.\n");
+                return EXIT_FAILURE;
+#endif
+            case 'q': {
+                char *end = NULL;
+                errno = 0;
+                opts.quantum = strtoull(optarg, &end, 0);
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.quantum) {
+                    fprintf(stderr, "bad quantum: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 's':
+                opts.snapshot = optarg;
+                break;
+            case 'S': {
+                char *end = NULL;
+                errno = 0;
+                opts.snapshot_at = strtoull(optarg, &end, 0);
+                if (0 != errno || end == optarg || '\0' != *end ||
+                    0 == opts.snapshot_at) {
+                    fprintf(stderr, "bad instruction count: %s\n", optarg);
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 't':
+                opts.timing = true;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (NULL != opts.trace_decode) {
+        if (0 != argc - optind) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        return (VMDEUX_SUCCESS == vmdeux_trace_print(opts.trace_decode,
+                                                     stdout)) ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (opts.trace_stream && NULL == opts.trace) {
+        fprintf(stderr, "--trace-stream needs --trace\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (NULL != opts.batch) {
+        struct batch_opts bo;
+        if (0 != argc - optind) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        if (NULL != opts.record || NULL != opts.replay ||
+            NULL != opts.trace || opts.hwcounters ||
+            NULL != opts.checkpoint) {
+            fprintf(stderr, "--record, --replay, --trace, --hwcounters and "
+                    "--checkpoint don't work with --batch\n");
+            return EXIT_FAILURE;
+        }
+        bo.engine = opts.engine;
+        bo.nworkers = opts.jobs;
+        bo.line_flush = opts.line_flush;
+        bo.quantum = opts.quantum;
+        bo.max_arrays = opts.max_arrays;
+        bo.max_words = opts.max_words;
+        bo.arena = opts.arena;
+        bo.arena_compact = opts.arena_compact;
+        bo.thp = opts.thp;
+        return (VMDEUX_SUCCESS == batch_run(opts.batch, &bo)) ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    /* enough args? */
+    if (1 != argc - optind) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    opts.exe = argv[optind];
+    if (0 != opts.snapshot_at && NULL == opts.snapshot) {
+        fprintf(stderr, "--snapshot-at needs --snapshot\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    /* valid path? */
+    if (-1 == access(opts.exe, F_OK | R_OK)) {
+        int err = errno;
+        fprintf(stderr, "cannot read %s - %s.\n", opts.exe, strerror(err));
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (0 != opts.lockstep) {
+        struct lockstep_opts lo;
+        if (NULL != opts.record || NULL != opts.replay ||
+            NULL != opts.trace || NULL != opts.snapshot ||
+            NULL != opts.convert || NULL != opts.emit_c || opts.hwcounters ||
+            NULL != opts.checkpoint) {
+            fprintf(stderr, "--record, --replay, --trace, --snapshot, "
+                    "--convert, --emit-c, --hwcounters and --checkpoint "
+                    "don't work with --lockstep\n");
+            return EXIT_FAILURE;
+        }
+        lo.engine = opts.engine;
+        lo.every = opts.lockstep;
+        lo.line_flush = opts.line_flush;
+        lo.max_arrays = opts.max_arrays;
+        lo.max_words = opts.max_words;
+        lo.arena = opts.arena;
+        lo.arena_compact = opts.arena_compact;
+        lo.thp = opts.thp;
+        return (VMDEUX_SUCCESS == lockstep_run(opts.exe, &lo)) ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    /* if we are here, then we can read the input file */
+    if (VMDEUX_SUCCESS != go(&opts)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# runs the programs in tests/ on each engine, checks their output against
+# perf/expected and reports the best of RUNS runs. results are compared with
+# BASELINE when it exists. SAVE=1 makes this run the new baseline.
+#
+# usage: perf/bench.sh [VMDEUX]
+# environment: RUNS (3), ENGINES ("switch threaded jit"), PROGS, BASELINE,
+#              SAVE
+
+VMDEUX=${1:-./vmdeux}
+RUNS=${RUNS:-3}
+ENGINES=${ENGINES:-"switch threaded jit"}
+PROGS=${PROGS:-"helloworld fact6 square lsquare smlffact sandmark"}
+BASELINE=${BASELINE:-perf/bench.baseline}
+SAVE=${SAVE:-0}
+
+here=$(dirname "$0")
+tmp=${TMPDIR:-/tmp}/vmdeux-bench.$$
+trap 'rm -rf "$tmp"' EXIT INT TERM
+mkdir -p "$tmp" || exit 1
+
+# wall clock in nanoseconds
+now() {
+    date +%s%N
+}
+
+# value following key in vmdeux -t output
+field() {
+    sed -n "s/.* $1: \([0-9.]*\).*/\1/p" "$2" | head -n 1
+}
+
+fail=0
+printf '%-11s %-9s %10s %14s %9s %10s %6s\n' \
+       program engine wall_s instructions MIPS rss_kib check > "$tmp/results"
+for prog in $PROGS; do
+    input=/dev/null
+    if [ -f "$here/expected/$prog.in" ]; then
+        input="$here/expected/$prog.in"
+    fi
+    for engine in $ENGINES; do
+        best=
+        check=ok
+        run=0
+        while [ "$run" -lt "$RUNS" ]; do
+            start=$(now)
+            "$VMDEUX" -t -e "$engine" "tests/$prog" < "$input" \
+                > "$tmp/out" 2> "$tmp/err"
+            rc=$?
+            end=$(now)
+            ns=$((end - start))
+            if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+                best=$ns
+            fi
+            if [ 0 -ne "$rc" ] ||
+               ! cmp -s "$tmp/out" "$here/expected/$prog.out"; then
+                check=FAIL
+            fi
+            run=$((run + 1))
+        done
+        [ ok = "$check" ] || fail=1
+        insns=$(field instructions "$tmp/err")
+        rss=$(field "peak rss" "$tmp/err")
+        awk -v p="$prog" -v e="$engine" -v ns="$best" -v i="${insns:-0}" \
+            -v r="${rss:-0}" -v c="$check" 'BEGIN {
+            s = ns / 1e9
+            printf "%-11s %-9s %10.3f %14.0f %9.2f %10d %6s\n",
+                   p, e, s, i, (s > 0) ? i / s / 1e6 : 0, r, c
+        }' >> "$tmp/results"
+    done
+done
+
+if [ -f "$BASELINE" ]; then
+    echo "# against $BASELINE (wall and rss: - is better)"
+    awk 'NR == FNR {
+        if (!/^#/ && "program" != $1) {
+            wall[$1 " " $2] = $3
+            rss[$1 " " $2] = $6
+        }
+        next
+    }
+    FNR == 1 { printf "%s %9s %9s\n", $0, "d_wall%", "d_rss%"; next }
+    {
+        k = $1 " " $2
+        if (k in wall && wall[k] > 0 && rss[k] > 0) {
+            printf "%s %+9.1f %+9.1f\n", $0, 100 * ($3 - wall[k]) / wall[k],
+                   100 * ($6 - rss[k]) / rss[k]
+        }
+        else {
+            printf "%s %9s %9s\n", $0, "-", "-"
+        }
+    }' "$BASELINE" "$tmp/results"
+else
+    cat "$tmp/results"
+fi
+
+if [ 1 = "$SAVE" ]; then
+    {
+        echo "# $(uname -snm) $(date -u +%Y-%m-%dT%H:%M:%SZ) runs: $RUNS"
+        cat "$tmp/results"
+    } > "$BASELINE"
+    echo "# saved $BASELINE"
+fi
+
+exit $fail
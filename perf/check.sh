@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# runs the programs in tests/ on each engine, and as --emit-c translations,
+# and checks their output against perf/expected. aotwrite overwrites its own
+# code from inside a block that is only there because of a loadimm. on
+# STATE_ENGINE, each program's input is also recorded and replayed, and the
+# program is stopped halfway on a snapshot and picked up from it, and again
+# with a checkpoint log that it is then picked up from.
+#
+# usage: perf/check.sh [VMDEUX]
+# environment: ENGINES ("switch threaded jit unchecked"), STATE_ENGINE (jit),
+#              PROGS, CC
+
+VMDEUX=${1:-./vmdeux}
+ENGINES=${ENGINES:-"switch threaded jit unchecked"}
+STATE_ENGINE=${STATE_ENGINE:-jit}
+PROGS=${PROGS:-"helloworld fact6 square lsquare smlffact aotwrite sandmark"}
+CC=${CC:-cc}
+
+here=$(dirname "$0")
+lib=$(dirname "$VMDEUX")
+tmp=${TMPDIR:-/tmp}/vmdeux-check.$$
+trap 'rm -rf "$tmp"' EXIT INT TERM
+mkdir -p "$tmp" || exit 1
+
+fail=0
+# prints and remembers how one run went
+report() {
+    if [ 0 -eq "$2" ] && cmp -s "$tmp/out" "$here/expected/$1.out"; then
+        printf '%-11s %-10s ok\n' "$1" "$3"
+    else
+        printf '%-11s %-10s FAIL\n' "$1" "$3"
+        fail=1
+    fi
+}
+
+# instructions retired, from a -t report on stdin
+retired() {
+    sed -n 's/^engine: .* instructions: \([0-9]*\) .*/\1/p'
+}
+
+for prog in $PROGS; do
+    input=/dev/null
+    if [ -f "$here/expected/$prog.in" ]; then
+        input="$here/expected/$prog.in"
+    fi
+    for engine in $ENGINES; do
+        "$VMDEUX" -e "$engine" "tests/$prog" < "$input" > "$tmp/out"
+        report "$prog" $? "$engine"
+    done
+    if "$VMDEUX" --emit-c="$tmp/$prog.c" "tests/$prog" &&
+       "$CC" -O1 -I "$lib" -o "$tmp/$prog" "$tmp/$prog.c" "$lib/libvmdeux.a" \
+           -pthread; then
+        "$tmp/$prog" < "$input" > "$tmp/out"
+        report "$prog" $? emit-c
+    else
+        report "$prog" 1 emit-c
+    fi
+    # the recording run also says how far the program runs, so it can be
+    # stopped halfway. the replay gets no input but the log.
+    count=$("$VMDEUX" -e "$STATE_ENGINE" -t --record="$tmp/rec" "tests/$prog" \
+            < "$input" 2>&1 > /dev/null | retired)
+    "$VMDEUX" -e "$STATE_ENGINE" --replay="$tmp/rec" "tests/$prog" \
+        < /dev/null > "$tmp/out"
+    report "$prog" $? replay
+    half=$((${count:-0} / 2))
+    # both runs share stdin, so the second reads on from where the first
+    # stopped. a program with no jump after half (helloworld) just halts.
+    rm -f "$tmp/snap"
+    { "$VMDEUX" -e "$STATE_ENGINE" -s "$tmp/snap" -S "$half" "tests/$prog" &&
+      { [ ! -f "$tmp/snap" ] || "$VMDEUX" -e "$STATE_ENGINE" "$tmp/snap"; }
+    } < "$input" > "$tmp/out"
+    report "$prog" $? snapshot
+    # a checkpoint every sixteenth of the run, so the log has a base and
+    # deltas. stopping at the limit checkpoints too.
+    rm -f "$tmp/snap" "$tmp/ckpt"
+    { "$VMDEUX" -e "$STATE_ENGINE" --checkpoint="$tmp/ckpt" \
+          --checkpoint-every=$((${count:-0} / 16 + 1)) -s "$tmp/snap" \
+          -S "$half" "tests/$prog" &&
+      { [ ! -f "$tmp/snap" ] || "$VMDEUX" -e "$STATE_ENGINE" "$tmp/ckpt"; }
+    } < "$input" > "$tmp/out"
+    report "$prog" $? checkpoint
+done
+exit $fail
@@ -0,0 +1,198 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Size-class pool allocator.
+ *
+ * Requests are rounded up to a power of two between 1 << POOL_MIN_SHIFT and
+ * 1 << POOL_MAX_SHIFT bytes. Each class keeps a free list of objects handed
+ * back through pool_free and carves new objects out of calloc'd slabs. Slab
+ * memory starts out zeroed, so only recycled objects are cleared.
+ *
+ * Requests bigger than the largest class are not pooled, and come in two
+ * sizes. Those under POOL_MAP_MIN are calloc'd and freed. Those of
+ * POOL_MAP_MIN and up (the large array payloads) are anonymous mappings of
+ * their own: the kernel zeroes their pages as they are first touched, and
+ * munmap gives them back for sure, where free might hang on to them.
+ * Mappings of POOL_THP_MIN and up are also offered transparent huge pages
+ * when the pool's thp is set.
+ *
+ * The caller passes the original request size back to pool_free, so objects
+ * carry no header.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline int
+size_class(size_t nbytes)
+{
+    if (nbytes <= (1 << POOL_MIN_SHIFT)) {
+        return 0;
+    }
+    /* ceil(log2(nbytes)) - POOL_MIN_SHIFT */
+    return (int)(sizeof(unsigned long) * 8) -
+           __builtin_clzl((unsigned long)(nbytes - 1)) - POOL_MIN_SHIFT;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct pool *
+pool_create(void)
+{
+    return calloc(1, sizeof(struct pool));
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* frees the slabs. objects too big for a class, calloc'd or mapped, are not
+ * tracked, so they must have gone back through pool_free first. */
+void
+pool_destroy(struct pool *p)
+{
+    struct pool_slab *s = NULL, *n = NULL;
+
+    if (NULL == p) return;
+    for (s = p->slabs; NULL != s; s = n) {
+        n = s->next;
+        free(s);
+    }
+    free(p);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+new_slab(struct pool *p,
+         struct pool_class *c)
+{
+    struct pool_slab *s = NULL;
+
+    if (NULL == (s = calloc(1, POOL_SLAB_SIZE))) {
+        return -1;
+    }
+    s->next = p->slabs;
+    p->slabs = s;
+    /* keep objects aligned to at least 16 bytes */
+    c->bump = (char *)s + (1 << POOL_MIN_SHIFT);
+    c->bump_end = (char *)s + POOL_SLAB_SIZE;
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void *
+pool_alloc(struct pool *p,
+           size_t nbytes)
+{
+    int ci = size_class(nbytes);
+    struct pool_class *c = NULL;
+    size_t csize = 0;
+    void *obj = NULL;
+
+    if (unlikely(ci >= POOL_N_CLASSES)) {
+        p->large_allocs++;
+        if (nbytes >= POOL_MAP_MIN) {
+            obj = mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED == obj) {
+                return NULL;
+            }
+#ifdef MADV_HUGEPAGE
+            if (p->thp && nbytes >= POOL_THP_MIN) {
+                (void)madvise(obj, nbytes, MADV_HUGEPAGE);
+            }
+#endif
+            p->mapped_allocs++;
+            p->mapped_bytes += nbytes;
+            return obj;
+        }
+        return calloc(1, nbytes);
+    }
+    c = &p->cls[ci];
+    /* recycled object -- only part of it that the caller asked for is
+     * cleared. the rest is never read. */
+    if (likely(NULL != c->free)) {
+        obj = c->free;
+        c->free = c->free->next;
+        c->hits++;
+        return memset(obj, 0, nbytes);
+    }
+    csize = (size_t)1 << (ci + POOL_MIN_SHIFT);
+    if (unlikely((size_t)(c->bump_end - c->bump) < csize)) {
+        if (0 != new_slab(p, c)) {
+            return NULL;
+        }
+    }
+    obj = c->bump;
+    c->bump += csize;
+    c->misses++;
+    /* fresh slab memory is already zeroed */
+    return obj;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+pool_free(struct pool *p,
+          void *ptr,
+          size_t nbytes)
+{
+    int ci = size_class(nbytes);
+    struct pool_obj *o = (struct pool_obj *)ptr;
+
+    if (NULL == ptr) return;
+    if (unlikely(ci >= POOL_N_CLASSES)) {
+        p->large_frees++;
+        if (nbytes >= POOL_MAP_MIN) {
+            (void)munmap(ptr, nbytes);
+            return;
+        }
+        free(ptr);
+        return;
+    }
+    o->next = p->cls[ci].free;
+    p->cls[ci].free = o;
+    p->cls[ci].frees++;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+pool_stats(const struct pool *p,
+           FILE *f)
+{
+    int i;
+    uint64_t hits = 0, misses = 0;
+
+    fprintf(f, "%10s %14s %14s %14s\n", "class", "hits", "misses", "frees");
+    for (i = 0; i < POOL_N_CLASSES; ++i) {
+        const struct pool_class *c = &p->cls[i];
+        if (0 == c->hits + c->misses) continue;
+        fprintf(f, "%10lu %14"PRIu64" %14"PRIu64" %14"PRIu64"\n",
+                1UL << (i + POOL_MIN_SHIFT), c->hits, c->misses, c->frees);
+        hits += c->hits;
+        misses += c->misses;
+    }
+    fprintf(f, "%10s %14"PRIu64" %14"PRIu64"\n", "total", hits, misses);
+    fprintf(f, "%10s %14"PRIu64" %14s %14"PRIu64"\n", "large",
+            p->large_allocs, "", p->large_frees);
+    fprintf(f, "%10s %14"PRIu64" %14s %14s (%"PRIu64" bytes)\n", "mapped",
+            p->mapped_allocs, "", "", p->mapped_bytes);
+}
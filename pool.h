@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_POOL_H
+#define VMDEUX_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* smallest size class is 1 << POOL_MIN_SHIFT bytes */
+#define POOL_MIN_SHIFT 4
+/* largest size class is 1 << POOL_MAX_SHIFT bytes */
+#define POOL_MAX_SHIFT 16
+#define POOL_N_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+/* size of the chunks of memory carved up into size class objects */
+#define POOL_SLAB_SIZE (1 << 18)
+/* requests at least this big get pages of their own */
+#define POOL_MAP_MIN (1 << 18)
+/* mappings at least this big are offered transparent huge pages */
+#define POOL_THP_MIN (1 << 21)
+
+/* a recycled object. the link lives in the object itself. */
+struct pool_obj {
+    struct pool_obj *next;
+};
+
+struct pool_slab {
+    struct pool_slab *next;
+};
+
+struct pool_class {
+    /* recycled objects */
+    struct pool_obj *free;
+    /* unused tail of the current slab */
+    char *bump;
+    char *bump_end;
+    /* served from the free list */
+    uint64_t hits;
+    /* served from a slab */
+    uint64_t misses;
+    /* objects handed back */
+    uint64_t frees;
+};
+
+struct pool {
+    struct pool_class cls[POOL_N_CLASSES];
+    /* every slab ever allocated */
+    struct pool_slab *slabs;
+    /* requests too big for any size class */
+    uint64_t large_allocs;
+    uint64_t large_frees;
+    /* the ones of those that were mapped */
+    uint64_t mapped_allocs;
+    uint64_t mapped_bytes;
+    /* ask for transparent huge pages for big mappings */
+    bool thp;
+};
+
+struct pool *pool_create(void);
+void pool_destroy(struct pool *p);
+void *pool_alloc(struct pool *p, size_t nbytes);
+void pool_free(struct pool *p, void *ptr, size_t nbytes);
+void pool_stats(const struct pool *p, FILE *f);
+
+#endif /* VMDEUX_POOL_H */
@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "prof.h"
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct prof *
+prof_create(void)
+{
+    return calloc(1, sizeof(struct prof));
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+prof_destroy(struct prof *p)
+{
+    if (NULL == p) return;
+    free(p->pcs);
+    free(p);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+prof_grow(struct prof *p,
+          uint32_t pc)
+{
+    size_t nlen = (0 == p->npcs) ? 1024 : p->npcs;
+    uint64_t *npcs = NULL;
+
+    while (pc >= nlen) {
+        nlen *= 2;
+    }
+    if (NULL == (npcs = realloc(p->pcs, nlen * sizeof(*npcs)))) {
+        p->lost = 1;
+        return;
+    }
+    (void)memset(npcs + p->npcs, 0, (nlen - p->npcs) * sizeof(*npcs));
+    p->pcs = npcs;
+    p->npcs = nlen;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* keeps top sorted by descending count */
+static size_t
+top_insert(uint32_t *top,
+           size_t ntop,
+           const uint64_t *pcs,
+           uint32_t pc)
+{
+    size_t i = ntop;
+
+    if (PROF_TOP_PCS == ntop) {
+        if (pcs[top[ntop - 1]] >= pcs[pc]) return ntop;
+        --i;
+    }
+    else {
+        ++ntop;
+    }
+    for (; i > 0 && pcs[top[i - 1]] < pcs[pc]; --i) {
+        top[i] = top[i - 1];
+    }
+    top[i] = pc;
+    return ntop;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+prof_report(const struct prof *p,
+            FILE *f,
+            const char *const *opnames,
+            const uint32_t *zero,
+            size_t zlen)
+{
+    int order[16];
+    uint32_t top[PROF_TOP_PCS];
+    size_t ntop = 0, pc;
+    uint64_t total = 0;
+    int i, j;
+
+    for (i = 0; i < 16; ++i) {
+        total += p->ops[i];
+        /* insertion sort by descending count */
+        for (j = i; j > 0 && p->ops[order[j - 1]] < p->ops[i]; --j) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    fprintf(f, "profile: %"PRIu64" instructions\n", total);
+    fprintf(f, "%10s %16s %8s\n", "opcode", "count", "%");
+    for (i = 0; i < 16 && 0 != p->ops[order[i]]; ++i) {
+        int op = order[i];
+        fprintf(f, "%10s %16"PRIu64" %8.2f\n",
+                (op < 14 && NULL != opnames[op]) ? opnames[op] : "invalid",
+                p->ops[op], 100.0 * (double)p->ops[op] / (double)total);
+    }
+
+    for (pc = 0; pc < p->npcs; ++pc) {
+        if (0 != p->pcs[pc]) {
+            ntop = top_insert(top, ntop, p->pcs, (uint32_t)pc);
+        }
+    }
+    fprintf(f, "hot program counters%s\n",
+            p->lost ? " (incomplete -- out of memory)" : "");
+    fprintf(f, "%10s %16s %8s %10s %s\n", "pc", "count", "%", "word", "op");
+    for (i = 0; i < (int)ntop; ++i) {
+        uint32_t hpc = top[i];
+        fprintf(f, "%10"PRIu32" %16"PRIu64" %8.2f ", hpc, p->pcs[hpc],
+                100.0 * (double)p->pcs[hpc] / (double)total);
+        /* loadprog may have replaced what ran there */
+        if (hpc < zlen) {
+            uint32_t op = zero[hpc] >> 28;
+            fprintf(f, "0x%08"PRIx32" %s\n", zero[hpc],
+                    (op < 14 && NULL != opnames[op]) ? opnames[op] :
+                    "invalid");
+        }
+        else {
+            fprintf(f, "%10s -\n", "-");
+        }
+    }
+
+    fprintf(f, "%10s %16s %16s\n", "arrays", "count", "bytes");
+    fprintf(f, "%10s %16"PRIu64" %16"PRIu64"\n", "alloc", p->nalloc,
+            p->alloc_bytes);
+    fprintf(f, "%10s %16"PRIu64" %16"PRIu64"\n", "dealloc", p->ndealloc,
+            p->dealloc_bytes);
+    fprintf(f, "%10s %16"PRIu64" %16"PRIu64"\n", "loadprog", p->nloadprog,
+            p->loadprog_bytes);
+}
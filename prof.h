@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_PROF_H
+#define VMDEUX_PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* hot program counters listed by prof_report */
+#define PROF_TOP_PCS 20
+
+/*
+ * opcode and program counter profile. the hooks that feed it are only
+ * compiled into profiling builds (VMDEUX_PROFILE, see make profile).
+ */
+struct prof {
+    /* executions per opcode */
+    uint64_t ops[16];
+    /* executions per zero array index. grows to the largest pc seen. */
+    uint64_t *pcs;
+    size_t npcs;
+    /* array traffic */
+    uint64_t nalloc;
+    uint64_t alloc_bytes;
+    uint64_t ndealloc;
+    uint64_t dealloc_bytes;
+    uint64_t nloadprog;
+    uint64_t loadprog_bytes;
+    /* prof_insn couldn't grow pcs. the histogram is incomplete. */
+    int lost;
+};
+
+struct prof *prof_create(void);
+void prof_destroy(struct prof *p);
+/* slow path of prof_insn */
+void prof_grow(struct prof *p, uint32_t pc);
+/*
+ * prints the sorted report. opnames is indexed by opcode. zero is the zero
+ * array at exit, used to say what the hot program counters hold.
+ */
+void prof_report(const struct prof *p, FILE *f, const char *const *opnames,
+                 const uint32_t *zero, size_t zlen);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+prof_insn(struct prof *p,
+          uint32_t pc,
+          uint32_t w)
+{
+    p->ops[w >> 28]++;
+    if (__builtin_expect(pc >= p->npcs, 0)) {
+        prof_grow(p, pc);
+        if (pc >= p->npcs) return;
+    }
+    p->pcs[pc]++;
+}
+
+#endif /* VMDEUX_PROF_H */
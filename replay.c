@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "replay.h"
+
+/* tells a log from one written with the other byte order */
+#define REPLAY_ENDIAN 0x01020304U
+
+/* recording buffer. logs are written as the guest reads, so keep it big. */
+#define REPLAY_BUF_SIZE (1 << 16)
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct replay *
+replay_record(const char *path)
+{
+    struct replay *r = NULL;
+    replay_hdr_t hdr;
+    int err = 0;
+
+    if (NULL == (r = calloc(1, sizeof(*r)))) {
+        return NULL;
+    }
+    if (NULL == (r->f = fopen(path, "wb"))) {
+        goto fail;
+    }
+    (void)setvbuf(r->f, NULL, _IOFBF, REPLAY_BUF_SIZE);
+    (void)memset(&hdr, 0, sizeof(hdr));
+    (void)memcpy(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic));
+    hdr.endian = REPLAY_ENDIAN;
+    hdr.version = REPLAY_VERSION;
+    if (1 != fwrite(&hdr, sizeof(hdr), 1, r->f)) {
+        goto fail;
+    }
+    return r;
+fail:
+    err = errno;
+    if (NULL != r->f) {
+        (void)fclose(r->f);
+    }
+    free(r);
+    errno = err;
+    return NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct replay *
+replay_open(const char *path)
+{
+    struct replay *r = NULL;
+    const replay_hdr_t *hdr = NULL;
+    struct stat sb;
+    int fd = -1, err = 0;
+
+    if (NULL == (r = calloc(1, sizeof(*r)))) {
+        return NULL;
+    }
+    r->map = MAP_FAILED;
+    if (-1 == (fd = open(path, O_RDONLY)) || 0 != fstat(fd, &sb)) {
+        goto fail;
+    }
+    if ((size_t)sb.st_size < sizeof(*hdr)) {
+        errno = EINVAL;
+        goto fail;
+    }
+    r->map_len = (size_t)sb.st_size;
+    r->map = mmap(NULL, r->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == r->map) {
+        goto fail;
+    }
+    hdr = (const replay_hdr_t *)r->map;
+    if (0 != memcmp(hdr->magic, REPLAY_MAGIC, sizeof(hdr->magic)) ||
+        REPLAY_ENDIAN != hdr->endian || REPLAY_VERSION != hdr->version) {
+        errno = EINVAL;
+        goto fail;
+    }
+    (void)close(fd);
+    r->ent = (const replay_ent_t *)(hdr + 1);
+    /* a recording that was cut short may end in part of an entry */
+    r->nent = (r->map_len - sizeof(*hdr)) / sizeof(*r->ent);
+    return r;
+fail:
+    err = errno;
+    if (MAP_FAILED != r->map) {
+        (void)munmap(r->map, r->map_len);
+    }
+    if (-1 != fd) {
+        (void)close(fd);
+    }
+    free(r);
+    errno = err;
+    return NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+replay_close(struct replay *r)
+{
+    int rc = 0;
+
+    if (NULL == r) return 0;
+    if (NULL != r->f) {
+        if (0 != ferror(r->f)) rc = -1;
+        if (0 != fclose(r->f)) rc = -1;
+    }
+    if (NULL != r->map) {
+        (void)munmap(r->map, r->map_len);
+    }
+    free(r);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+replay_put(struct replay *r,
+           uint64_t icount,
+           uint32_t val)
+{
+    replay_ent_t e;
+
+    e.icount = icount;
+    e.val = val;
+    e.pad = 0;
+    return (1 == fwrite(&e, sizeof(e), 1, r->f)) ? 0 : -1;
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_REPLAY_H
+#define VMDEUX_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * input logs. every value OP11 hands the guest (end of input included) is
+ * logged with the number of instructions retired before that OP11 ran. the
+ * machine is deterministic apart from its input, so feeding a log back
+ * repeats the run exactly, whichever engine runs it.
+ *
+ * a log is a replay_hdr_t followed by replay_ent_t entries, in host byte
+ * order like snapshots.
+ */
+#define REPLAY_MAGIC   "vmdeuxIL"
+#define REPLAY_VERSION 1
+
+typedef struct replay_hdr_t {
+    char magic[8];
+    /* REPLAY_ENDIAN as written by the recording host */
+    uint32_t endian;
+    uint32_t version;
+} replay_hdr_t;
+
+typedef struct replay_ent_t {
+    uint64_t icount;
+    uint32_t val;
+    uint32_t pad;
+} replay_ent_t;
+
+struct replay {
+    /* recording: where entries go. NULL when replaying. */
+    FILE *f;
+    /* replaying: the mapped log and the entry up next */
+    void *map;
+    size_t map_len;
+    const replay_ent_t *ent;
+    size_t nent;
+    size_t next;
+};
+
+/* starts a log at path. NULL on failure, with errno set. */
+struct replay *replay_record(const char *path);
+/* maps the log at path. NULL on failure, with errno set (EINVAL if bad). */
+struct replay *replay_open(const char *path);
+/* returns -1 if anything that was recorded didn't make it out */
+int replay_close(struct replay *r);
+/* returns -1 on write errors */
+int replay_put(struct replay *r, uint64_t icount, uint32_t val);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* the entry up next, NULL once the log is used up */
+static inline const replay_ent_t *
+replay_peek(const struct replay *r)
+{
+    return (r->next < r->nent) ? &r->ent[r->next] : NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+replay_skip(struct replay *r)
+{
+    r->next++;
+}
+
+#endif /* VMDEUX_REPLAY_H */
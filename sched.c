@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * a cooperative scheduler for lots of machines on one thread. vmdeux_run
+ * keeps everything in the machine, so a slice is just a call with a limit a
+ * quantum past where the machine is now.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "sched.h"
+#include "util.h"
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* gives t one slice. returns its vmdeux_run return code. */
+static int
+slice(struct sched_task *t,
+      int engine,
+      uint64_t quantum)
+{
+    struct vmdeux_stats st;
+    uint64_t limit = UINT64_MAX;
+    double start = 0.0;
+    int rc;
+
+    vmdeux_stats(t->vm, &st);
+    if (UINT64_MAX - st.icount > quantum) {
+        limit = st.icount + quantum;
+    }
+    start = now();
+    rc = vmdeux_run(t->vm, engine, limit);
+    t->secs += now() - start;
+    t->nslices++;
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+sched_run(struct sched_task *tasks,
+          size_t n,
+          int engine,
+          uint64_t quantum)
+{
+    /* ready is a ring of task indices. waiting is a plain list. */
+    size_t *ready = NULL, *waiting = NULL;
+    size_t rhead = 0, nready = 0, nwaiting = 0, i;
+    struct pollfd *pfd = NULL;
+    int rc = VMDEUX_SUCCESS;
+
+    if (0 == n) return VMDEUX_SUCCESS;
+    if (NULL == (ready = calloc(n, sizeof(*ready))) ||
+        NULL == (waiting = calloc(n, sizeof(*waiting))) ||
+        NULL == (pfd = calloc(n, sizeof(*pfd)))) {
+        rc = VMDEUX_ERR_OOR;
+        goto out;
+    }
+    for (i = 0; i < n; ++i) {
+        ready[nready++] = i;
+    }
+    while (0 != nready + nwaiting) {
+        /* everybody that is ready now gets one slice */
+        size_t round = nready, j, k;
+        int np;
+
+        while (0 != round--) {
+            size_t id = ready[rhead];
+            struct sched_task *t = &tasks[id];
+            int trc;
+
+            rhead = (rhead + 1) % n;
+            nready--;
+            trc = slice(t, engine, quantum);
+            if (VMDEUX_YIELD == trc) {
+                ready[(rhead + nready++) % n] = id;
+            }
+            else if (VMDEUX_WAIT == trc && -1 != t->fd) {
+                waiting[nwaiting++] = id;
+            }
+            else {
+                t->rc = (VMDEUX_WAIT == trc) ? VMDEUX_ERR_IO : trc;
+            }
+        }
+        if (0 == nwaiting) continue;
+        /* block only if there is nothing else to do */
+        for (j = 0; j < nwaiting; ++j) {
+            pfd[j].fd = tasks[waiting[j]].fd;
+            pfd[j].events = POLLIN;
+            pfd[j].revents = 0;
+        }
+        np = poll(pfd, (nfds_t)nwaiting, (0 == nready) ? -1 : 0);
+        if (0 > np) {
+            if (EINTR == errno) continue;
+            rc = VMDEUX_ERR_IO;
+            goto out;
+        }
+        /* hangups and errors are ready too. the read will sort them out. */
+        for (j = k = 0; j < nwaiting; ++j) {
+            if (0 != pfd[j].revents) {
+                ready[(rhead + nready++) % n] = waiting[j];
+            }
+            else {
+                waiting[k++] = waiting[j];
+            }
+        }
+        nwaiting = k;
+    }
+
+out:
+    free(ready);
+    free(waiting);
+    free(pfd);
+    return rc;
+}
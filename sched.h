@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_SCHED_H
+#define VMDEUX_SCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vmdeux.h"
+
+/* a machine for sched_run */
+struct sched_task {
+    vmdeux_t *vm;
+    /*
+     * polled while the machine waits for input. -1 if there is nothing to
+     * wait on, in which case waiting for input is an i/o error.
+     */
+    int fd;
+    /* how vmdeux_run finished with it */
+    int rc;
+    /* time spent in vmdeux_run, and how many times it got there */
+    double secs;
+    uint64_t nslices;
+};
+
+/*
+ * runs all n tasks to completion on the calling thread. ready machines take
+ * turns at quantum instructions each. machines waiting for input sit out
+ * until their fd polls readable. returns VMDEUX_SUCCESS unless the scheduler
+ * itself fails; how each task went is in its rc.
+ */
+int sched_run(struct sched_task *tasks, size_t n, int engine,
+              uint64_t quantum);
+
+#endif /* VMDEUX_SCHED_H */
@@ -0,0 +1,294 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+/* tells a trace from one written with the other byte order */
+#define TRACE_ENDIAN 0x01020304U
+
+/* shortest ring handed out */
+#define TRACE_MIN_LEN 1024
+/* a streaming ring is handed to the writer in this many pieces */
+#define TRACE_CHUNKS 8
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct trace *
+trace_create(uint64_t len)
+{
+    struct trace *t = NULL;
+    uint64_t n = TRACE_MIN_LEN;
+
+    while (n < len && n <= (UINT64_MAX >> 1)) {
+        n <<= 1;
+    }
+    if ((size_t)n != n || SIZE_MAX / sizeof(trace_rec_t) < n) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (NULL == (t = calloc(1, sizeof(*t)))) {
+        return NULL;
+    }
+    if (NULL == (t->ring = malloc((size_t)n * sizeof(*t->ring)))) {
+        free(t);
+        return NULL;
+    }
+    t->mask = n - 1;
+    t->chunk_mask = UINT64_MAX;
+    return t;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+trace_destroy(struct trace *t)
+{
+    int rc = 0;
+
+    if (NULL == t) return 0;
+    if (t->streaming) {
+        (void)pthread_mutex_lock(&t->lock);
+        /* the last chunk is only partly filled */
+        t->ready = t->head;
+        t->stop = true;
+        (void)pthread_cond_signal(&t->more);
+        (void)pthread_mutex_unlock(&t->lock);
+        (void)pthread_join(t->writer, NULL);
+        if (t->werr) rc = -1;
+        if (0 != fclose(t->f)) rc = -1;
+        (void)pthread_cond_destroy(&t->more);
+        (void)pthread_cond_destroy(&t->room);
+        (void)pthread_mutex_destroy(&t->lock);
+    }
+    free(t->ring);
+    free(t);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* writes records [from, to) out of the ring */
+static int
+put_recs(const struct trace *t,
+         FILE *f,
+         uint64_t from,
+         uint64_t to)
+{
+    while (from < to) {
+        uint64_t at = from & t->mask;
+        uint64_t n = t->mask + 1 - at;
+
+        if (n > to - from) {
+            n = to - from;
+        }
+        if ((size_t)n != fwrite(&t->ring[at], sizeof(*t->ring), (size_t)n,
+                                f)) {
+            return -1;
+        }
+        from += n;
+    }
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+put_hdr(FILE *f,
+        uint64_t first)
+{
+    trace_hdr_t hdr;
+
+    (void)memset(&hdr, 0, sizeof(hdr));
+    (void)memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.endian = TRACE_ENDIAN;
+    hdr.version = TRACE_VERSION;
+    hdr.first = first;
+    return (1 == fwrite(&hdr, sizeof(hdr), 1, f)) ? 0 : -1;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+trace_dump(const struct trace *t,
+           const char *path)
+{
+    uint64_t n = (t->head > t->mask) ? t->mask + 1 : t->head;
+    FILE *f = NULL;
+    int rc = 0, err = 0;
+
+    if (NULL == (f = fopen(path, "wb"))) {
+        return -1;
+    }
+    if (0 != put_hdr(f, t->head - n) ||
+        0 != put_recs(t, f, t->head - n, t->head)) {
+        rc = -1;
+    }
+    err = errno;
+    if (0 != fclose(f)) {
+        return -1;
+    }
+    errno = err;
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void *
+writer(void *arg)
+{
+    struct trace *t = (struct trace *)arg;
+
+    (void)pthread_mutex_lock(&t->lock);
+    while (true) {
+        uint64_t from = t->written, to = t->ready;
+
+        if (from == to) {
+            if (t->stop) break;
+            (void)pthread_cond_wait(&t->more, &t->lock);
+            continue;
+        }
+        (void)pthread_mutex_unlock(&t->lock);
+        /* the machine keeps off these records until written moves past */
+        if (!t->werr && 0 != put_recs(t, t->f, from, to)) {
+            t->werr = true;
+        }
+        (void)pthread_mutex_lock(&t->lock);
+        /* even when nothing could be written, or the machine would wait */
+        t->written = to;
+        (void)pthread_cond_signal(&t->room);
+    }
+    (void)pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+trace_stream(struct trace *t,
+             const char *path)
+{
+    int err = 0;
+
+    if (t->streaming) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (NULL == (t->f = fopen(path, "wb"))) {
+        return -1;
+    }
+    t->chunk_mask = (t->mask + 1) / TRACE_CHUNKS - 1;
+    /* pick up from the start of the chunk being filled */
+    t->ready = t->written = t->head & ~t->chunk_mask;
+    t->stop = t->werr = false;
+    if (0 != put_hdr(t->f, t->written)) {
+        goto fail;
+    }
+    (void)pthread_mutex_init(&t->lock, NULL);
+    (void)pthread_cond_init(&t->more, NULL);
+    (void)pthread_cond_init(&t->room, NULL);
+    if (0 != (err = pthread_create(&t->writer, NULL, writer, t))) {
+        (void)pthread_cond_destroy(&t->more);
+        (void)pthread_cond_destroy(&t->room);
+        (void)pthread_mutex_destroy(&t->lock);
+        errno = err;
+        goto fail;
+    }
+    t->streaming = true;
+    return 0;
+fail:
+    err = errno;
+    (void)fclose(t->f);
+    t->f = NULL;
+    t->chunk_mask = UINT64_MAX;
+    errno = err;
+    return -1;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+trace_chunk(struct trace *t)
+{
+    uint64_t len = t->mask + 1, chunk = t->chunk_mask + 1;
+
+    (void)pthread_mutex_lock(&t->lock);
+    t->ready = t->head;
+    (void)pthread_cond_signal(&t->more);
+    /* the next chunk still holds records the writer hasn't got to */
+    while (t->head + chunk - t->written > len) {
+        (void)pthread_cond_wait(&t->room, &t->lock);
+    }
+    (void)pthread_mutex_unlock(&t->lock);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+print_rec(FILE *f,
+          const char *const *opnames,
+          uint64_t seq,
+          const trace_rec_t *r)
+{
+    unsigned op = r->w >> 28;
+
+    fprintf(f, "%12"PRIu64" %08"PRIx32" %08"PRIx32" %-8s ", seq, r->pc,
+            r->w, opnames[op]);
+    if (0xD == op) {
+        fprintf(f, "r%u <- %08"PRIx32"\n", (unsigned)((r->w >> 25) & 7),
+                r->w & 0x01FFFFFFU);
+        return;
+    }
+    fprintf(f, "r%u=%08"PRIx32" r%u=%08"PRIx32" r%u=%08"PRIx32"\n",
+            (unsigned)((r->w >> 6) & 7), r->a, (unsigned)((r->w >> 3) & 7),
+            r->b, (unsigned)(r->w & 7), r->c);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+trace_print(const char *path,
+            FILE *f,
+            const char *const *opnames)
+{
+    trace_rec_t recs[4096];
+    trace_hdr_t hdr;
+    uint64_t seq = 0;
+    size_t n = 0, i;
+    FILE *in = NULL;
+    int rc = 0;
+
+    if (NULL == (in = fopen(path, "rb"))) {
+        return -1;
+    }
+    if (1 != fread(&hdr, sizeof(hdr), 1, in) ||
+        0 != memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) ||
+        TRACE_ENDIAN != hdr.endian || TRACE_VERSION != hdr.version) {
+        (void)fclose(in);
+        errno = EINVAL;
+        return -1;
+    }
+    fprintf(f, "%12s %8s %8s %-8s registers as found\n", "seq", "pc", "insn",
+            "op");
+    seq = hdr.first;
+    /* a trace cut short may end in part of a record */
+    while (0 < (n = fread(recs, sizeof(*recs), 4096, in))) {
+        for (i = 0; i < n; ++i) {
+            print_rec(f, opnames, seq++, &recs[i]);
+        }
+    }
+    if (0 != ferror(in)) {
+        rc = -1;
+    }
+    (void)fclose(in);
+    return rc;
+}
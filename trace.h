@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VMDEUX_TRACE_H
+#define VMDEUX_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * execution trace. every instruction the tracing engine starts goes into a
+ * ring as a trace_rec_t, so the ring always holds the last len of them. it
+ * can be written out at any time (trace_dump), or a background writer can
+ * drain it into a file as it fills (trace_stream).
+ *
+ * a trace file is a trace_hdr_t followed by trace_rec_t records, oldest
+ * first, in host byte order like snapshots.
+ */
+#define TRACE_MAGIC   "vmdeuxTR"
+#define TRACE_VERSION 1
+
+typedef struct trace_hdr_t {
+    char magic[8];
+    /* TRACE_ENDIAN as written by the tracing host */
+    uint32_t endian;
+    uint32_t version;
+    /* sequence number of the first record. they count from 0. */
+    uint64_t first;
+} trace_hdr_t;
+
+typedef struct trace_rec_t {
+    uint32_t pc;
+    /* the instruction */
+    uint32_t w;
+    /*
+     * registers a, b and c as the instruction found them. loadimm names its
+     * register elsewhere, so these mean nothing for it.
+     */
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+} trace_rec_t;
+
+struct trace {
+    trace_rec_t *ring;
+    /* ring length, a power of two, less one */
+    uint64_t mask;
+    /* records ever written. the next one goes to ring[head & mask]. */
+    uint64_t head;
+    /*
+     * streaming. the ring is cut into chunks of chunk_mask + 1 records.
+     * every full chunk is handed to the writer thread, and a chunk is only
+     * reused after the writer took it. chunk_mask is UINT64_MAX otherwise,
+     * so trace_insn never takes its slow path.
+     */
+    uint64_t chunk_mask;
+    bool streaming;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    /* work for the writer, and room for the machine */
+    pthread_cond_t more;
+    pthread_cond_t room;
+    /* records handed to the writer, and records it wrote */
+    uint64_t ready;
+    uint64_t written;
+    bool stop;
+    FILE *f;
+    /* a write failed. the stream stops there. */
+    bool werr;
+};
+
+/* holds the last len records, len rounded up to a power of two. */
+struct trace *trace_create(uint64_t len);
+/* stops the writer after it has written everything */
+int trace_destroy(struct trace *t);
+/* writes what the ring holds to path. -1 on failure, with errno set. */
+int trace_dump(const struct trace *t, const char *path);
+/*
+ * from here on, drains the ring into path in the background. the machine
+ * stalls if it gets a ring ahead of the writer, so the file misses nothing.
+ */
+int trace_stream(struct trace *t, const char *path);
+/* slow path of trace_insn */
+void trace_chunk(struct trace *t);
+/*
+ * prints the trace file at path, one instruction per line. opnames is
+ * indexed by opcode. -1 on failure, with errno set (EINVAL if bad).
+ */
+int trace_print(const char *path, FILE *f, const char *const *opnames);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+trace_insn(struct trace *t,
+           uint32_t pc,
+           uint32_t w,
+           const uint32_t *mr)
+{
+    trace_rec_t *r = &t->ring[t->head & t->mask];
+
+    r->pc = pc;
+    r->w = w;
+    r->a = mr[(w >> 6) & 7];
+    r->b = mr[(w >> 3) & 7];
+    r->c = mr[w & 7];
+    if (__builtin_expect(0 == (++t->head & t->chunk_mask), 0)) {
+        trace_chunk(t);
+    }
+}
+
+#endif /* VMDEUX_TRACE_H */
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_UTIL_H
+#define VMDEUX_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* small helpers more than one module needs */
+
+/* 64-bit fnv-1a */
+#define FNV_INIT  0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* folds len bytes at buf into the fnv-1a hash h */
+static inline uint64_t
+fnv_bytes(uint64_t h,
+          const void *buf,
+          size_t len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        h = (h ^ p[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* same, a word at a time, which is four times fewer steps for arrays */
+static inline uint64_t
+fnv_words(uint64_t h,
+          const uint32_t *w,
+          size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        h = (h ^ w[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* seconds on the monotonic clock */
+static inline double
+now(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif /* VMDEUX_UTIL_H */
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -29,12 +30,22 @@
 #include <errno.h>
 #include <assert.h>
 #include <inttypes.h>
-#include <time.h>
-
-#include "redblack.h"
+#include <signal.h>
+
+#include "vmdeux.h"
+#include "pool.h"
+#include "jit.h"
+#include "vmio.h"
+#include "bswap.h"
+#include "prof.h"
+#include "arena.h"
+#include "replay.h"
+#include "trace.h"
+#include "aot.h"
+#include "ckpt.h"
+#include "util.h"
 
 #define PACKAGE     "vmdeux"
-#define PACKAGE_VER "0.2"
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x)  STRINGIFY(x)
@@ -64,6 +75,24 @@ do {                                                                           \
 #define likely(x)   __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
+#define always_inline inline __attribute__((always_inline))
+
+/* profiling hooks. only profiling builds (make profile) have them. */
+#ifdef VMDEUX_PROFILE
+#define PROF(vm, stmt)                                                         \
+do {                                                                           \
+    if (unlikely(NULL != (vm)->prof)) {                                        \
+        struct prof *prof_ = (vm)->prof;                                       \
+        stmt;                                                                  \
+    }                                                                          \
+} while (0)
+#else
+#define PROF(vm, stmt)                                                         \
+do {                                                                           \
+    ;                                                                          \
+} while (0)
+#endif
+
 /* opcode is given by the bits 28:31 */
 #define OP_MASK  0xF0000000U
 
@@ -90,7 +119,7 @@ do {                                                                           \
 #define RB 0x00000038U
 #define RC 0x00000007U
 
-char *opstrs[32] = {
+static const char *const opstrs[32] = {
     "cmov",
     "aidx",
     "aupd",
@@ -108,23 +137,129 @@ char *opstrs[32] = {
     NULL
 };
 
+/* the public return codes under their old names */
+enum {
+    SUCCESS = VMDEUX_SUCCESS,
+    ERR = VMDEUX_ERR,
+    ERR_OOR = VMDEUX_ERR_OOR,
+    ERR_IO = VMDEUX_ERR_IO,
+    ERR_IOOB = VMDEUX_ERR_IOOB,
+    ERR_INVLD_INPUT = VMDEUX_ERR_INVLD_INPUT,
+    HALT = VMDEUX_HALT,
+    /* an engine stopped at a safe point because icount reached ilimit */
+    YIELD = VMDEUX_YIELD,
+    /* an input instruction found nothing to read yet. pc is still on it. */
+    WAIT = VMDEUX_WAIT,
+    /* an allocation would have gone past max_words or max_arrays */
+    ERR_LIMIT = VMDEUX_ERR_LIMIT
+};
+
+/* initial number of slots in the address space handle table */
+#define AS_INIT_SLOTS 1024
+
+/* where an asi_t payload lives */
 enum {
-    SUCCESS = 0,
-    ERR,
-    ERR_OOR,
-    ERR_IO,
-    ERR_IOOB,
-    ERR_INVLD_INPUT,
-    HALT
+    /* handed out by vm->pool */
+    ASI_POOL = 0,
+    /* points into vm->img or a vmdeux_image_t. not ours to free. */
+    ASI_IMAGE
 };
 
 /* address space item typedef'd stuct */
 typedef struct asi_t {
-    uint32_t key;
     uint32_t *addp;
     size_t addp_len;
+    /* holders of a shared addp (see loadprog). NULL if addp is ours alone. */
+    uint32_t *refs;
+    /* ASI_POOL or ASI_IMAGE */
+    uint32_t kind;
 } asi_t;
 
+/* pre-swapped image header. the words follow in host byte order. */
+#define NIMG_MAGIC  "vmdeuxNI"
+#define NIMG_ENDIAN 0x01020304U
+
+typedef struct nimg_hdr_t {
+    char magic[8];
+    /* NIMG_ENDIAN as written by the host that made the image */
+    uint32_t endian;
+    uint32_t nwords;
+} nimg_hdr_t;
+
+/*
+ * snapshot file: snap_hdr_t, then narrays snap_arr_t, nfree recycled ids and
+ * ilen bytes of pending input. the payloads follow at the offsets given in the
+ * table, SNAP_ALIGN aligned. everything is in host byte order, so a snapshot
+ * can be mapped and run as is.
+ */
+#define SNAP_MAGIC   "vmdeuxSS"
+#define SNAP_VERSION 1
+#define SNAP_ALIGN   16
+
+typedef struct snap_hdr_t {
+    char magic[8];
+    /* NIMG_ENDIAN */
+    uint32_t endian;
+    uint32_t version;
+    uint32_t mr[N_REGISTERS];
+    uint32_t pc;
+    /* lowest id never handed out */
+    uint32_t next_id;
+    uint64_t icount;
+    /* entries in the array table. the zero array comes first. */
+    uint32_t narrays;
+    /* array the zero array shares its payload with, 0 if none */
+    uint32_t zshare;
+    /* recycled ids, bottom of the free stack first */
+    uint32_t nfree;
+    /* input read ahead of the guest */
+    uint32_t ilen;
+} snap_hdr_t;
+
+typedef struct snap_arr_t {
+    uint32_t id;
+    uint32_t nwords;
+    /* payload offset from the start of the file */
+    uint64_t off;
+} snap_arr_t;
+
+/* address space -- a dense handle table indexed by array id */
+typedef struct as_t {
+    /* slot i holds the array with id i. slot 0 is the zero array. */
+    asi_t **tab;
+    /* number of slots in tab */
+    uint32_t tab_len;
+    /* lowest id that has never been handed out */
+    uint32_t next_id;
+    /* stack of recycled ids */
+    uint32_t *free_ids;
+    /* number of ids on the free stack */
+    uint32_t free_len;
+    /* capacity of the free stack */
+    uint32_t free_cap;
+    /* arrays other than the zero array, and the words they hold */
+    uint64_t live_arrays;
+    uint64_t live_words;
+    /* high water marks of the two */
+    uint64_t peak_arrays;
+    uint64_t peak_words;
+    /* caps on live_arrays and live_words. 0 means none. */
+    uint64_t max_arrays;
+    uint64_t max_words;
+    /* allocations turned down because of a cap */
+    uint64_t nlimited;
+} as_t;
+
+/* predecoded instruction */
+typedef struct pdi_t {
+    /* handler */
+    const void *h;
+    /* loadimm immediate */
+    uint32_t x;
+    /* register indices. loadimm only uses a. */
+    uint8_t a, b, c;
+} pdi_t;
+
 typedef struct vm_t {
     /* size of application image */
     size_t app_size;
@@ -134,10 +269,73 @@ typedef struct vm_t {
     uint32_t mr[N_REGISTERS];
     /* program counter */
     uint32_t pc;
-    /* address space using a red-black tree */
-    struct rbtree *as;
+    /* instructions retired */
+    uint64_t icount;
+    /*
+     * engines return YIELD at the first jump (or loadprog) once icount gets
+     * here. vm_interrupt drops it to 0 to get control back early.
+     */
+    volatile uint64_t ilimit;
+    /* vm_interrupt was called and the engine hasn't yielded for it yet */
+    volatile sig_atomic_t intr;
+    /* address space */
+    as_t as;
     /* pointer to zero array */
     asi_t *zap;
+    /* recycles asi_t headers and array payloads */
+    struct pool *pool;
+    /* console */
+    struct vmio *io;
+    /* private mapping of a pre-swapped image, if that's what we loaded */
+    void *img;
+    size_t img_len;
+    /* the zero array started out as a vmdeux_image_t */
+    bool img_shared;
+    /* predecoded copy of the zero array, NULL unless run_threaded built it */
+    pdi_t *pd;
+    /* handler labels of run_threaded, indexed by opcode. set by run_threaded. */
+    const void *const *thr_optab;
+    /* translator state, kept across run_jit calls */
+    struct jit *jit;
+    struct jit_frame jf;
+    /* jit_create failed once already */
+    bool no_jit;
+    /* --profile counters, NULL if not profiling */
+    struct prof *prof;
+    /* bytes loadprog shared instead of copying */
+    uint64_t cow_shared;
+    /* bytes copied later because a shared array was written */
+    uint64_t cow_copied;
+    /* loadprogs from arrays other than the zero array */
+    uint64_t nloadprog;
+    /*
+     * if not NULL, arrays other than the zero array live here instead of the
+     * handle table, and their ids are arena offsets
+     */
+    struct arena *arena;
+    /* input log being written and input log being fed back, NULL if none */
+    struct replay *rec;
+    struct replay *replay;
+    /* execution trace, NULL if not tracing */
+    struct trace *trace;
+    /* checkpoint log, NULL if none */
+    struct ckpt *ck;
+    /*
+     * the arrays as of the last checkpoint, indexed by id, 0 being the zero
+     * array. each entry holds its payload the way loadprog does, so a write
+     * after the checkpoint copies first and leaves the writer's copy alone.
+     * an array whose refs isn't the one here has changed since. entries with
+     * no refs are arrays that weren't live.
+     */
+    asi_t *ck_view;
+    uint32_t ck_nview;
+    /* words in the last base and in the deltas after it */
+    uint64_t ck_base_words;
+    uint64_t ck_delta_words;
+    /* records captured, and the words in them */
+    uint64_t ck_bases;
+    uint64_t ck_deltas;
+    uint64_t ck_words;
 } vm_t;
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -159,55 +357,137 @@ out_reg(const vm_t *vm,
 
 /* ////////////////////////////////////////////////////////////////////////// */
 static inline int
-asi_construct(const vm_t *vm,
+asi_construct(vm_t *vm,
               size_t addp_len,
               asi_t **newa)
 {
-    static asi_t *tmp = NULL;
+    asi_t *tmp = NULL;
 
-    if (unlikely(NULL == (tmp = calloc(1, sizeof(*tmp))))) {
+    if (unlikely(NULL == (tmp = pool_alloc(vm->pool, sizeof(*tmp))))) {
         return ERR_OOR;
     }
-    if (unlikely(NULL == (tmp->addp = calloc(addp_len, vm->word_size)))) {
+    if (unlikely(NULL == (tmp->addp = pool_alloc(vm->pool,
+                                                 addp_len * vm->word_size)))) {
+        pool_free(vm->pool, tmp, sizeof(*tmp));
         return ERR_OOR;
     }
     tmp->addp_len = addp_len;
-    /* key not populated here */
     *newa = tmp;
     return SUCCESS;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
-/* callback for asi_t compares */
-static inline int
-cmp_asi_t_cb(const void *v1,
-             const void *v2)
+/* drops asi's hold on its payload. the last holder frees it. */
+static inline void
+asi_release(vm_t *vm,
+            asi_t *asi)
 {
-    static int64_t a = 0, b = 0;
-
-    a = ((asi_t *)(v1))->key;
-    b = ((asi_t *)(v2))->key;
+    if (unlikely(NULL != asi->refs)) {
+        if (0 != --*asi->refs) {
+            asi->refs = NULL;
+            asi->addp = NULL;
+            return;
+        }
+        pool_free(vm->pool, asi->refs, sizeof(*asi->refs));
+        asi->refs = NULL;
+    }
+    if (likely(NULL != asi->addp)) {
+        /* image payloads go with the mapping in vm_destruct */
+        if (likely(ASI_POOL == asi->kind)) {
+            pool_free(vm->pool, asi->addp, asi->addp_len * vm->word_size);
+        }
+        asi->addp = NULL;
+    }
+}
 
-    return (a - b);
+/* ////////////////////////////////////////////////////////////////////////// */
+/* gives asi a payload of its own before it is written */
+static int
+asi_unshare(vm_t *vm,
+            asi_t *asi)
+{
+    uint32_t *np = NULL;
+    size_t nbytes = asi->addp_len * vm->word_size;
+
+    /* everybody else let go already */
+    if (1 == *asi->refs) {
+        pool_free(vm->pool, asi->refs, sizeof(*asi->refs));
+        asi->refs = NULL;
+        return SUCCESS;
+    }
+    if (unlikely(NULL == (np = pool_alloc(vm->pool, nbytes)))) {
+        return ERR_OOR;
+    }
+    (void)memcpy(np, asi->addp, nbytes);
+    --*asi->refs;
+    asi->refs = NULL;
+    asi->addp = np;
+    asi->kind = ASI_POOL;
+    vm->cow_copied += nbytes;
+    return SUCCESS;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
 static inline void
-asi_rb_free_cb(void *p)
+asi_destruct(vm_t *vm,
+             asi_t *tmp)
 {
-    asi_t *tmp = (asi_t *)p;
+    asi_release(vm, tmp);
+    pool_free(vm->pool, tmp, sizeof(*tmp));
+}
 
-    if (unlikely(NULL != tmp->addp)) {
-        free(tmp->addp);
-        tmp->addp = NULL;
+/* ////////////////////////////////////////////////////////////////////////// */
+/* makes v another holder of asi's payload (see vm_t.ck_view) */
+static inline int
+view_share(vm_t *vm,
+           asi_t *asi,
+           asi_t *v)
+{
+    if (NULL == asi->refs) {
+        if (unlikely(NULL == (asi->refs = pool_alloc(vm->pool,
+                                                     sizeof(*asi->refs))))) {
+            return ERR_OOR;
+        }
+        *asi->refs = 1;
     }
-    free(tmp);
+    ++*asi->refs;
+    *v = *asi;
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* lets go of the checkpoint view. the writer must be done with it. */
+static void
+view_release(vm_t *vm)
+{
+    uint32_t id;
+
+    for (id = 0; id < vm->ck_nview; ++id) {
+        if (NULL != vm->ck_view[id].refs) {
+            asi_release(vm, &vm->ck_view[id]);
+        }
+    }
+    free(vm->ck_view);
+    vm->ck_view = NULL;
+    vm->ck_nview = 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* makes the running engine return YIELD soon. async-signal-safe. */
+static void
+vm_interrupt(vm_t *vm)
+{
+    vm->intr = 1;
+    vm->ilimit = 0;
+    vm->jf.ilimit = 0;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
 static int
-vm_construct(vm_t **new)
+vm_construct(vm_t **new,
+             const struct vmdeux_config *cfg)
 {
+    struct vmio_cb cb;
     vm_t *tmp = NULL;
 
     if (NULL == new) {
@@ -221,11 +501,69 @@ vm_construct(vm_t **new)
     tmp->app_size = 0;
     tmp->word_size = sizeof(uint32_t);
     tmp->pc = 0;
-    /* create the address space */
-    if (NULL == (tmp->as = rbcreate(cmp_asi_t_cb))) {
+    tmp->ilimit = UINT64_MAX;
+    /* create the address space. id 0 is reserved for the zero array. */
+    tmp->as.tab_len = AS_INIT_SLOTS;
+    tmp->as.next_id = 1;
+    if (NULL == (tmp->as.tab = calloc(tmp->as.tab_len,
+                                      sizeof(*tmp->as.tab)))) {
+        free(tmp);
+        return ERR_OOR;
+    }
+    if (NULL == (tmp->pool = pool_create())) {
+        free(tmp->as.tab);
         free(tmp);
         return ERR_OOR;
     }
+    (void)memset(&cb, 0, sizeof(cb));
+    if (NULL != cfg) {
+        cb.ctx = cfg->io.ctx;
+        cb.read = cfg->io.read;
+        cb.write = cfg->io.write;
+    }
+    if (NULL == (tmp->io = vmio_create(&cb))) {
+        pool_destroy(tmp->pool);
+        free(tmp->as.tab);
+        free(tmp);
+        return ERR_OOR;
+    }
+    if (NULL != cfg) {
+        tmp->io->line_flush = cfg->line_flush;
+        tmp->as.max_arrays = cfg->max_arrays;
+        tmp->as.max_words = cfg->max_words;
+        tmp->pool->thp = cfg->thp;
+        if (cfg->arena &&
+            NULL == (tmp->arena = arena_create(cfg->arena_compact))) {
+            vmio_destroy(tmp->io);
+            pool_destroy(tmp->pool);
+            free(tmp->as.tab);
+            free(tmp);
+            return ERR_OOR;
+        }
+        if (NULL != tmp->arena) {
+            tmp->arena->thp = cfg->thp;
+        }
+#ifdef VMDEUX_PROFILE
+        if (cfg->profile && NULL == (tmp->prof = prof_create())) {
+            arena_destroy(tmp->arena);
+            vmio_destroy(tmp->io);
+            pool_destroy(tmp->pool);
+            free(tmp->as.tab);
+            free(tmp);
+            return ERR_OOR;
+        }
+#endif
+        if (0 != cfg->trace_len &&
+            NULL == (tmp->trace = trace_create(cfg->trace_len))) {
+            prof_destroy(tmp->prof);
+            arena_destroy(tmp->arena);
+            vmio_destroy(tmp->io);
+            pool_destroy(tmp->pool);
+            free(tmp->as.tab);
+            free(tmp);
+            return ERR_OOR;
+        }
+    }
 
     *new = tmp;
     return SUCCESS;
@@ -235,77 +573,187 @@ vm_construct(vm_t **new)
 static int
 vm_destruct(vm_t *vm)
 {
+    uint32_t id;
+
     if (NULL == vm) return ERR_INVLD_INPUT;
-    rbdestroy(vm->as, asi_rb_free_cb);
+    jit_destroy(vm->jit);
+    /* the writer may still be at the view's payloads */
+    if (0 != ckpt_destroy(vm->ck)) {
+        int err = errno;
+        fprintf(stderr, "checkpoint write failure: %d (%s)\n", err,
+                strerror(err));
+    }
+    view_release(vm);
+    /* slot 0 is the zero array */
+    for (id = 1; id < vm->as.next_id; ++id) {
+        if (NULL != vm->as.tab[id]) {
+            asi_destruct(vm, vm->as.tab[id]);
+        }
+    }
     if (vm->zap) {
-        free(vm->zap->addp);
-        free(vm->zap);
+        asi_destruct(vm, vm->zap);
+    }
+    /* the arrays are back in the pool, so only its slabs are left */
+    pool_destroy(vm->pool);
+    vmio_destroy(vm->io);
+    if (NULL != vm->img) {
+        (void)munmap(vm->img, vm->img_len);
     }
+    free(vm->pd);
+    prof_destroy(vm->prof);
+    arena_destroy(vm->arena);
+    if (0 != replay_close(vm->rec)) {
+        fprintf(stderr, "input log write failure\n");
+    }
+    (void)replay_close(vm->replay);
+    if (0 != trace_destroy(vm->trace)) {
+        fprintf(stderr, "trace write failure\n");
+    }
+    free(vm->as.tab);
+    free(vm->as.free_ids);
     free(vm);
     return SUCCESS;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
-static inline bool
-idtaken(const vm_t *vm,
+/* makes sure the handle table has a slot for id */
+static int
+as_grow(as_t *as,
         uint32_t id)
 {
-    if (0 == id) {
-        return true;
+    size_t nlen = as->tab_len;
+    asi_t **ntab = NULL;
+
+    while (id >= nlen) {
+        nlen *= 2;
+    }
+    if (nlen > UINT32_MAX) {
+        nlen = UINT32_MAX;
+    }
+    if (unlikely(NULL == (ntab = realloc(as->tab, nlen * sizeof(*ntab))))) {
+        return ERR_OOR;
     }
-    return (NULL != rbfind(vm->as, &id));
+    (void)memset(ntab + as->tab_len, 0,
+                 (nlen - as->tab_len) * sizeof(*ntab));
+    as->tab = ntab;
+    as->tab_len = (uint32_t)nlen;
+    return SUCCESS;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
 static inline int
-getid(const vm_t *vm,
+getid(vm_t *vm,
       uint32_t *id)
 {
-    static uint32_t tid = 0;
+    as_t *as = &vm->as;
+
+    /* recycled ids first */
+    if (0 != as->free_len) {
+        *id = as->free_ids[--as->free_len];
+        return SUCCESS;
+    }
+    /* id space exhausted -- UINT32_MAX can't be a slot index */
+    if (unlikely(UINT32_MAX == as->next_id)) {
+        return ERR_OOR;
+    }
+    if (unlikely(as->next_id >= as->tab_len)) {
+        int rc = as_grow(as, as->next_id);
+        if (SUCCESS != rc) return rc;
+    }
+    *id = as->next_id++;
+    return SUCCESS;
+}
 
-    do {
-        tid += 1;
-    } while (idtaken(vm, tid));
-    /* at this point we should have a valid id */
-    *id = tid;
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline int
+putid(vm_t *vm,
+      uint32_t id)
+{
+    as_t *as = &vm->as;
+
+    if (unlikely(as->free_len == as->free_cap)) {
+        size_t ncap = (0 == as->free_cap) ? AS_INIT_SLOTS
+                                          : (size_t)as->free_cap * 2;
+        uint32_t *nids = NULL;
+        /* same cap as the slot table, so the doubling can't wrap */
+        if (ncap > UINT32_MAX) ncap = UINT32_MAX;
+        if (ncap == as->free_cap) return ERR_OOR;
+        if (NULL == (nids = realloc(as->free_ids, ncap * sizeof(*nids)))) {
+            return ERR_OOR;
+        }
+        as->free_ids = nids;
+        as->free_cap = (uint32_t)ncap;
+    }
+    as->free_ids[as->free_len++] = id;
     return SUCCESS;
 }
 
+/* ////////////////////////////////////////////////////////////////////////// */
+/* true if one more array of nwords would go past a cap */
+static inline bool
+over_limit(const as_t *as,
+           size_t nwords)
+{
+    return (0 != as->max_arrays && as->live_arrays >= as->max_arrays) ||
+           (0 != as->max_words && nwords > as->max_words - as->live_words);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 static inline int
 alloc_array(vm_t *vm,
             size_t nwords,
             uint32_t *id)
 {
-    static int rc = SUCCESS;
+    int rc = SUCCESS;
     /* available id */
-    static uint32_t aid = 0;
+    uint32_t aid = 0;
     /* address space item pointer */
-    static asi_t *asi = NULL;
+    asi_t *asi = NULL;
 
     /* not dealing with zero array */
     if (NULL != id) {
-        if (SUCCESS != (rc = getid(vm, &aid))) {
+        as_t *as = &vm->as;
+        if (unlikely(over_limit(as, nwords))) {
+            as->nlimited++;
+            if (0 != as->max_arrays && as->live_arrays >= as->max_arrays) {
+                fprintf(stderr, "array allocation refused: %"PRIu64" arrays "
+                        "live, the limit is %"PRIu64"\n", as->live_arrays,
+                        as->max_arrays);
+            }
+            else {
+                fprintf(stderr, "array allocation of %lu words refused: "
+                        "%"PRIu64" words live, the limit is %"PRIu64"\n",
+                        (unsigned long)nwords, as->live_words, as->max_words);
+            }
+            return ERR_LIMIT;
+        }
+        if (NULL != vm->arena) {
+            if (unlikely(0 != arena_alloc(vm->arena, (uint32_t)nwords, &aid))) {
+                return ERR_OOR;
+            }
+        }
+        else if (SUCCESS != (rc = getid(vm, &aid))) {
             return rc;
         }
     }
-    if (unlikely(SUCCESS != (rc = asi_construct(vm, nwords, &asi)))) {
-        return rc;
+    if (NULL == vm->arena || NULL == id) {
+        if (unlikely(SUCCESS != (rc = asi_construct(vm, nwords, &asi)))) {
+            if (NULL != id) (void)putid(vm, aid);
+            return rc;
+        }
+        /* zero array gets id 0 */
+        vm->as.tab[aid] = asi;
     }
-    /* not dealing with zero array */
     if (NULL != id) {
-        asi->key = aid;
         *id = aid;
-    }
-    /* zero array gets id 0 */
-    else {
-        asi->key = 0;
-    }
-    if (NULL != id) {
-        /* now add the thing to the rbtree */
-        if (unlikely(NULL != rbinsert(vm->as, (void *)asi))) {
-            return ERR;
+        if (++vm->as.live_arrays > vm->as.peak_arrays) {
+            vm->as.peak_arrays = vm->as.live_arrays;
         }
+        if ((vm->as.live_words += nwords) > vm->as.peak_words) {
+            vm->as.peak_words = vm->as.live_words;
+        }
+        PROF(vm, (prof_->nalloc++,
+                  prof_->alloc_bytes += nwords * vm->word_size));
     }
     else {
         vm->zap = asi;
@@ -314,43 +762,41 @@ alloc_array(vm_t *vm,
     return SUCCESS;
 }
 
-/* ////////////////////////////////////////////////////////////////////////// */
-static inline struct rbnode *
-find_node(const vm_t *vm,
-          uint32_t id)
-{
-    static struct rbnode *node = NULL;
-
-    if (unlikely(NULL == (node = rbfind(vm->as, &id)))) {
-        return NULL;
-    }
-    return node;
-}
-
 /* ////////////////////////////////////////////////////////////////////////// */
 static inline int
 dealloc_array(vm_t *vm,
               uint32_t id)
 {
-    static struct rbnode *target = NULL;
-    static asi_t *data = NULL;
+    asi_t *data = NULL;
 
     if (unlikely(0 == id)) {
         fprintf(stderr, "error: can't dealloc zero array\n");
         return ERR;
     }
-
-    target = find_node(vm, id);
-
-    if (unlikely(NULL == target)) {
+    if (NULL != vm->arena) {
+        uint32_t len = 0;
+        if (unlikely(0 != arena_free(vm->arena, id, &len))) {
+            fprintf(stderr, "freeing unalloc'd array\n");
+            return ERR;
+        }
+        vm->as.live_arrays--;
+        vm->as.live_words -= len;
+        PROF(vm, (prof_->ndealloc++,
+                  prof_->dealloc_bytes += len * vm->word_size));
+        return SUCCESS;
+    }
+    if (unlikely(id >= vm->as.tab_len || NULL == (data = vm->as.tab[id]))) {
         fprintf(stderr, "freeing unalloc'd array\n");
         return ERR;
     }
-    data = rbdelete(vm->as, target);
-    free(data->addp);
-    free(data);
-
-    return SUCCESS;
+    vm->as.tab[id] = NULL;
+    vm->as.live_arrays--;
+    vm->as.live_words -= data->addp_len;
+    PROF(vm, (prof_->ndealloc++,
+              prof_->dealloc_bytes += data->addp_len * vm->word_size));
+    asi_destruct(vm, data);
+
+    return putid(vm, id);
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -358,28 +804,247 @@ static inline asi_t *
 getasip(const vm_t *vm,
         uint32_t id)
 {
-    static struct rbnode *node = NULL;
-
-    if (0 == id) return vm->zap;
+    if (unlikely(id >= vm->as.tab_len)) {
+        return NULL;
+    }
+    return vm->as.tab[id];
+}
 
-    node = find_node(vm, id);
+/* ////////////////////////////////////////////////////////////////////////// */
+/* true if id names an array, with either backend */
+static inline bool
+array_live(const vm_t *vm,
+           uint32_t id)
+{
+    if (NULL != vm->arena && 0 != id) {
+        return arena_live(vm->arena, id);
+    }
+    return NULL != getasip(vm, id);
+}
 
-    if (unlikely(NULL == node)) {
-        return NULL;
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+pd_decode(const vm_t *vm,
+          pdi_t *d,
+          uint32_t w)
+{
+    d->h = vm->thr_optab[w >> 28];
+    if (OP13 == (w & OP_MASK)) {
+        d->a = (w >> 25) & 0x7;
+        d->x = w & 0x01FFFFFFU;
     }
     else {
-        return (asi_t *)node->data;
+        d->a = (w & RA) >> 6;
+        d->b = (w & RB) >> 3;
+        d->c = (w & RC);
     }
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
+/* (re)builds the predecoded copy of the zero array */
 static int
-doop(vm_t *vm)
+pd_build(vm_t *vm)
+{
+    size_t i, len = vm->zap->addp_len;
+    pdi_t *pd = NULL;
+
+    /* one extra entry that catches pc running off the end */
+    if (unlikely(NULL == (pd = realloc(vm->pd, (len + 1) * sizeof(*pd))))) {
+        return ERR_OOR;
+    }
+    for (i = 0; i < len; ++i) {
+        pd_decode(vm, &pd[i], vm->zap->addp[i]);
+    }
+    (void)memset(&pd[len], 0, sizeof(*pd));
+    pd[len].h = vm->thr_optab[16];
+    vm->pd = pd;
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* keeps the predecoded copy in step with a write to the zero array */
+static inline void
+pd_update(vm_t *vm,
+          uint32_t idx,
+          uint32_t w)
+{
+    if (NULL != vm->pd) {
+        pd_decode(vm, &vm->pd[idx], w);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+vm_out(vm_t *vm,
+       uint32_t val)
+{
+    vmio_putc(vm->io, val);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* next input from the log being replayed. the terminal is never touched. */
+static int
+vm_in_replay(vm_t *vm,
+             uint32_t *val,
+             uint64_t icount,
+             bool quiet)
+{
+    const replay_ent_t *e = replay_peek(vm->replay);
+
+    if (NULL == e) {
+        /* the recording stopped here. there is nothing more to read. */
+        *val = VMIO_EOF;
+        return SUCCESS;
+    }
+    if (unlikely(e->icount != icount)) {
+        if (!quiet) {
+            fprintf(stderr, "replay diverged: input read after %"PRIu64" "
+                    "instructions, log has it after %"PRIu64"\n",
+                    icount, e->icount);
+        }
+        return ERR;
+    }
+    *val = e->val;
+    replay_skip(vm->replay);
+    if (VMIO_EOF != *val) {
+        vm->io->in_bytes++;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+vm_in_record(vm_t *vm,
+             uint32_t val,
+             uint64_t icount)
+{
+    int rc = replay_put(vm->rec, icount, val);
+
+    /* don't sit on entries while the guest waits for more input */
+    if (0 == rc && vm->io->ipos == vm->io->ilen) {
+        rc = fflush(vm->rec->f);
+    }
+    if (unlikely(0 != rc)) {
+        int err = errno;
+        fprintf(stderr, "input log write failure: %d (%s). "
+                "recording stopped.\n", err, strerror(err));
+        (void)replay_close(vm->rec);
+        vm->rec = NULL;
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * icount is the number of instructions retired before this one. quiet
+ * callers (the jit and translated code) leave the complaint to the
+ * interpreter, which tries the instruction again.
+ */
+static inline int
+vm_in(vm_t *vm,
+      uint32_t *val,
+      uint64_t icount,
+      bool quiet)
+{
+    int rc = SUCCESS;
+
+    if (unlikely(NULL != vm->replay)) {
+        if (SUCCESS != (rc = vm_in_replay(vm, val, icount, quiet))) {
+            return rc;
+        }
+    }
+    else if (unlikely(0 != (rc = vmio_getc(vm->io, val)))) {
+        int err = errno;
+        if (VMIO_AGAIN == rc) {
+            return WAIT;
+        }
+        if (!quiet) {
+            fprintf(stderr, "read failure: %d (%s)\n", err, strerror(err));
+        }
+        return ERR_IO;
+    }
+    if (unlikely(NULL != vm->rec)) {
+        vm_in_record(vm, *val, icount);
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * replaces the zero array with a copy of array id. the copy is deferred: both
+ * arrays share one payload until either one is written (asi_unshare) or
+ * abandoned (asi_release). arena arrays can be freed and reused behind the
+ * zero array's back, so those are copied right away.
+ */
+static int
+loadprog(vm_t *vm,
+         uint32_t id)
 {
+    asi_t *za = NULL;
+    asi_t *newp = NULL;
+
+    if (NULL != vm->arena) {
+        uint32_t len = 0, *src = NULL, *np = NULL;
+        if (unlikely(!arena_live(vm->arena, id) ||
+                     NULL == (src = arena_array(vm->arena, id, &len)))) {
+            return ERR;
+        }
+        if (unlikely(NULL == (np = pool_alloc(vm->pool,
+                                              len * vm->word_size)))) {
+            return ERR_OOR;
+        }
+        (void)memcpy(np, src, len * vm->word_size);
+        za = vm->zap;
+        asi_release(vm, za);
+        za->addp = np;
+        za->addp_len = len;
+        za->kind = ASI_POOL;
+        vm->nloadprog++;
+        PROF(vm, (prof_->nloadprog++,
+                  prof_->loadprog_bytes += len * vm->word_size));
+        return (NULL != vm->pd) ? pd_build(vm) : SUCCESS;
+    }
+    if (unlikely(NULL == (newp = getasip(vm, id)))) {
+        return ERR;
+    }
+    za = vm->zap;
+    if (NULL == newp->refs) {
+        if (unlikely(NULL == (newp->refs = pool_alloc(vm->pool,
+                                                      sizeof(*newp->refs))))) {
+            return ERR_OOR;
+        }
+        *newp->refs = 1;
+    }
+    asi_release(vm, za);
+    ++*newp->refs;
+    za->refs = newp->refs;
+    za->addp = newp->addp;
+    za->addp_len = newp->addp_len;
+    za->kind = newp->kind;
+    vm->cow_shared += newp->addp_len * vm->word_size;
+    vm->nloadprog++;
+    PROF(vm, (prof_->nloadprog++,
+              prof_->loadprog_bytes += newp->addp_len * vm->word_size));
+    if (NULL != vm->pd) {
+        return pd_build(vm);
+    }
+    return SUCCESS;
+}
 
-    static uint32_t rega = 0, regb = 0, regc = 0, w = 0;
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * forced inline so the switch loop in run stays one function. checked is
+ * always a constant: without it, ids, indices, divisors and opcodes are taken
+ * to be good and the tests for them are compiled out. that is only for images
+ * known to behave (see run_unchecked). what a bad one does then is undefined.
+ */
+static always_inline int
+doop_as(vm_t *vm,
+        const bool checked)
+{
+    uint32_t rega, regb, regc, w;
 
     w = vm->zap->addp[vm->pc];
+    PROF(vm, prof_insn(prof_, vm->pc, w));
 
     /* machine register index */
     rega = (w & RA) >> 6; /* 6:8 */
@@ -394,11 +1059,26 @@ doop(vm_t *vm)
             break;
         }
         case OP1: {
-            asi_t *asi = getasip(vm, vm->mr[regb]);
-            if (unlikely(NULL == asi)) {
+            asi_t *asi = NULL;
+            if (NULL != vm->arena && 0 != vm->mr[regb]) {
+                uint32_t len = 0;
+                const uint32_t *p = arena_array(vm->arena, vm->mr[regb], &len);
+                if (checked && unlikely(NULL == p || vm->mr[regc] >= len)) {
+                    fprintf(stderr, "array oob @ line %d: "
+                            "requested: %"PRIu32" but max is: %"PRIu32"\n",
+                            __LINE__, vm->mr[regc], len);
+                    return ERR;
+                }
+                vm->mr[rega] = p[vm->mr[regc]];
+                break;
+            }
+            if (!checked) {
+                asi = vm->as.tab[vm->mr[regb]];
+            }
+            else if (unlikely(NULL == (asi = getasip(vm, vm->mr[regb])))) {
                 return ERR;
             }
-            if (unlikely(vm->mr[regc] >= asi->addp_len)) {
+            if (checked && unlikely(vm->mr[regc] >= asi->addp_len)) {
                 fprintf(stderr, "array oob @ line %d: "
                         "requested: %"PRIu32" but max is: %lu\n",
                         __LINE__, vm->mr[regc],
@@ -409,18 +1089,39 @@ doop(vm_t *vm)
             break;
         }
         case OP2: {
-            asi_t *asi = getasip(vm, vm->mr[rega]);
-            if (unlikely(NULL == asi)) {
+            asi_t *asi = NULL;
+            if (NULL != vm->arena && 0 != vm->mr[rega]) {
+                uint32_t len = 0;
+                uint32_t *p = arena_array(vm->arena, vm->mr[rega], &len);
+                if (checked && unlikely(NULL == p || vm->mr[regb] >= len)) {
+                    fprintf(stderr, "array oob @ line %d: "
+                            "requested: %"PRIu32" but max is: %"PRIu32"\n",
+                            __LINE__, vm->mr[regb], len);
+                    return ERR;
+                }
+                p[vm->mr[regb]] = vm->mr[regc];
+                break;
+            }
+            if (!checked) {
+                asi = vm->as.tab[vm->mr[rega]];
+            }
+            else if (unlikely(NULL == (asi = getasip(vm, vm->mr[rega])))) {
                 return ERR;
             }
-            if (unlikely(vm->mr[regb] >= asi->addp_len)) {
+            if (checked && unlikely(vm->mr[regb] >= asi->addp_len)) {
                 fprintf(stderr, "array oob @ line %d: "
                         "requested: %"PRIu32" but max is: %lu\n",
                         __LINE__, vm->mr[regb],
                         (unsigned long)asi->addp_len);
                 return ERR;
             }
+            if (unlikely(NULL != asi->refs && SUCCESS != asi_unshare(vm, asi))) {
+                return ERR_OOR;
+            }
             asi->addp[vm->mr[regb]] = vm->mr[regc];
+            if (unlikely(0 == vm->mr[rega])) {
+                pd_update(vm, vm->mr[regb], vm->mr[regc]);
+            }
             break;
         }
         case OP3: {
@@ -432,7 +1133,7 @@ doop(vm_t *vm)
             break;
         }
         case OP5: {
-            if (unlikely(0 == vm->mr[regc])) {
+            if (checked && unlikely(0 == vm->mr[regc])) {
                 fprintf(stderr, "div by 0 @ %d\n", __LINE__);
                 return ERR;
             }
@@ -447,9 +1148,10 @@ doop(vm_t *vm)
         case OP7:
             return HALT;
         case OP8: {
-            static uint32_t id = 0;
-            if (unlikely(SUCCESS != alloc_array(vm, vm->mr[regc], &id))) {
-                return ERR;
+            uint32_t id = 0;
+            int rc = alloc_array(vm, vm->mr[regc], &id);
+            if (unlikely(SUCCESS != rc)) {
+                return (ERR_LIMIT == rc) ? rc : ERR;
             }
             vm->mr[regb] = id;
             break;
@@ -462,41 +1164,28 @@ doop(vm_t *vm)
             break;
         }
         case OP10: {
-            printf("%c", (char)vm->mr[regc]);
+            vm_out(vm, vm->mr[regc]);
             break;
         }
         case OP11: {
-            static char val = 0;
-            static int n = 0;
-            n = scanf("%c", &val);
-            if (1 != n) {
-                return ERR;
-            }
-            if (EOF == val) {
-                vm->mr[regc] = 0xFFFFFFFF;
-            }
-            else {
-                vm->mr[regc] = val;
+            int rc = vm_in(vm, &vm->mr[regc], vm->icount, false);
+            if (unlikely(SUCCESS != rc)) {
+                return rc;
             }
             break;
         }
         case OP12: {
             if (0 != vm->mr[regb]) {
-                asi_t *za = NULL;
-                asi_t *newp = NULL;
-
-                if (unlikely(NULL == (newp = getasip(vm, vm->mr[regb])))) {
-                    return ERR;
+                int rc = loadprog(vm, vm->mr[regb]);
+                if (unlikely(SUCCESS != rc)) {
+                    return rc;
                 }
-                za = vm->zap;
-                free(za->addp);
-                za->addp = calloc(newp->addp_len, vm->word_size);
-                za->addp_len = newp->addp_len;
-                (void)memmove(za->addp, newp->addp,
-                              newp->addp_len * vm->word_size);
             }
             /* else we are dealing with the current zero array */
             vm->pc = vm->mr[regc];
+            if (unlikely(vm->icount >= vm->ilimit)) {
+                return YIELD;
+            }
             return SUCCESS;
         }
         case OP13: {
@@ -513,6 +1202,7 @@ doop(vm_t *vm)
             break;
         }
         default:
+            if (!checked) __builtin_unreachable();
             fprintf(stderr, "invalid op @ %d\n", __LINE__);
             return ERR_IOOB;
     }
@@ -520,6 +1210,13 @@ doop(vm_t *vm)
     return SUCCESS;
 }
 
+/* ////////////////////////////////////////////////////////////////////////// */
+static always_inline int
+doop(vm_t *vm)
+{
+    return doop_as(vm, true);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 static int
 get_file_size(const char *path,
@@ -539,137 +1236,1948 @@ get_file_size(const char *path,
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
-static int
-load_app(vm_t *vm, const char *exe)
+static inline uint64_t
+snap_align(uint64_t off)
 {
-    int fd = -1;
-    ssize_t bread = 0;
-    uint32_t ibuf = 0;
-    int rc = SUCCESS;
-    size_t word_index = 0;
-    asi_t *zap = NULL;
-    size_t fsize = 0;
+    return (off + SNAP_ALIGN - 1) & ~(uint64_t)(SNAP_ALIGN - 1);
+}
 
-    if (NULL == vm || NULL == exe) return ERR_INVLD_INPUT;
+/* ////////////////////////////////////////////////////////////////////////// */
+/* writes n zero bytes of padding */
+static bool
+snap_pad(FILE *f,
+         uint64_t n)
+{
+    static const char zeros[SNAP_ALIGN];
 
-    if (SUCCESS != (rc = get_file_size(exe, &fsize))) {
-        return rc;
-    }
-    if (SUCCESS != (rc = alloc_array(vm, fsize / vm->word_size, NULL))) {
-        return rc;
+    return 0 == n || 1 == fwrite(zeros, (size_t)n, 1, f);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * writes the whole machine to path: registers, pc, instruction count, every
+ * live array under its id, the recycled ids and any input that was read ahead
+ * but not consumed. the file is written next to path and renamed into place,
+ * so an existing snapshot is never left half written.
+ */
+static int
+write_snapshot(vm_t *vm,
+               const char *path)
+{
+    snap_hdr_t hdr;
+    snap_arr_t *ents = NULL;
+    struct vmio *io = vm->io;
+    char *tmp = NULL;
+    FILE *f = NULL;
+    uint64_t off = 0;
+    uint32_t id, i, n = 0;
+    int rc = SUCCESS;
+
+    /* arena ids are offsets the format has no room for */
+    if (NULL != vm->arena) {
+        fprintf(stderr, "snapshots don't work with the arena\n");
+        return ERR_INVLD_INPUT;
     }
-    zap = vm->zap;
-    if (-1 == (fd = open(exe, O_RDONLY))) {
+    (void)memset(&hdr, 0, sizeof(hdr));
+    (void)memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.endian = NIMG_ENDIAN;
+    hdr.version = SNAP_VERSION;
+    (void)memcpy(hdr.mr, vm->mr, sizeof(hdr.mr));
+    hdr.pc = vm->pc;
+    hdr.next_id = vm->as.next_id;
+    hdr.icount = vm->icount;
+    hdr.nfree = vm->as.free_len;
+    hdr.ilen = (uint32_t)(io->ilen - io->ipos);
+    /* zero array first */
+    hdr.narrays = 1;
+    for (id = 1; id < vm->as.next_id; ++id) {
+        if (NULL != vm->as.tab[id]) hdr.narrays++;
+    }
+    if (NULL == (ents = calloc(hdr.narrays, sizeof(*ents)))) {
+        return ERR_OOR;
+    }
+    off = snap_align(sizeof(hdr) + hdr.narrays * sizeof(*ents) +
+                     hdr.nfree * sizeof(uint32_t) + hdr.ilen);
+    ents[n].id = 0;
+    ents[n++].nwords = (uint32_t)vm->zap->addp_len;
+    for (id = 1; id < vm->as.next_id; ++id) {
+        const asi_t *asi = vm->as.tab[id];
+        if (NULL == asi) continue;
+        ents[n].id = id;
+        ents[n].nwords = (uint32_t)asi->addp_len;
+        ents[n].off = off;
+        off = snap_align(off + asi->addp_len * vm->word_size);
+        /* a payload loadprog shared is only written once */
+        if (NULL != vm->zap->refs && asi->addp == vm->zap->addp) {
+            hdr.zshare = id;
+            ents[0].off = ents[n].off;
+        }
+        n++;
+    }
+    if (0 == hdr.zshare) {
+        ents[0].off = off;
+    }
+    /* the guest may have said something we haven't passed on yet */
+    (void)vmio_flush(io);
+
+    if (NULL == (tmp = malloc(strlen(path) + sizeof(".tmp")))) {
+        rc = ERR_OOR;
+        goto out;
+    }
+    (void)sprintf(tmp, "%s.tmp", path);
+    if (NULL == (f = fopen(tmp, "wb"))) {
         int err = errno;
         fprintf(stderr, "open failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+        goto out;
+    }
+    off = sizeof(hdr) + hdr.narrays * sizeof(*ents) +
+          hdr.nfree * sizeof(uint32_t) + hdr.ilen;
+    if (1 != fwrite(&hdr, sizeof(hdr), 1, f) ||
+        hdr.narrays != fwrite(ents, sizeof(*ents), hdr.narrays, f) ||
+        hdr.nfree != fwrite(vm->as.free_ids, sizeof(uint32_t), hdr.nfree, f) ||
+        (0 != hdr.ilen && 1 != fwrite(io->ibuf + io->ipos, hdr.ilen, 1, f))) {
+        goto werr;
+    }
+    /* payloads in table order, so the offsets only ever go up */
+    for (i = 1; i <= hdr.narrays; ++i) {
+        /* the zero array goes last unless it is shared */
+        const snap_arr_t *e = &ents[i % hdr.narrays];
+        const asi_t *asi = (0 == e->id) ? vm->zap : vm->as.tab[e->id];
+        if (0 == e->id && 0 != hdr.zshare) continue;
+        if (!snap_pad(f, e->off - off) ||
+            (0 != e->nwords &&
+             1 != fwrite(asi->addp, e->nwords * vm->word_size, 1, f))) {
+            goto werr;
+        }
+        off = e->off + (uint64_t)e->nwords * vm->word_size;
+    }
+    if (0 != fclose(f)) {
+        f = NULL;
+        goto werr;
+    }
+    f = NULL;
+    if (0 != rename(tmp, path)) {
+        goto werr;
+    }
+    goto out;
+
+werr: {
+        int err = errno;
+        fprintf(stderr, "write failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+        (void)unlink(tmp);
+    }
+out:
+    if (NULL != f) {
+        (void)fclose(f);
+    }
+    free(tmp);
+    free(ents);
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * picks the machine up from a mapped snapshot. the arrays are used in place,
+ * so all that happens here is hooking them into the handle table.
+ */
+static int
+restore_snapshot(vm_t *vm,
+                 void *map,
+                 size_t fsize)
+{
+    const snap_hdr_t *hdr = (const snap_hdr_t *)map;
+    const snap_arr_t *ents = NULL;
+    const uint32_t *free_ids = NULL;
+    uint64_t meta = 0;
+    uint32_t i;
+    int rc = SUCCESS;
+
+    /* the mapping is ours from here on, whatever happens */
+    vm->img = map;
+    vm->img_len = fsize;
+
+    if (fsize < sizeof(*hdr) || NIMG_ENDIAN != hdr->endian ||
+        SNAP_VERSION != hdr->version) {
+        fprintf(stderr, "snapshot is for another host or version\n");
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL != vm->arena) {
+        fprintf(stderr, "snapshots don't work with the arena\n");
+        return ERR_INVLD_INPUT;
+    }
+    meta = sizeof(*hdr) + (uint64_t)hdr->narrays * sizeof(*ents) +
+           (uint64_t)hdr->nfree * sizeof(uint32_t) + hdr->ilen;
+    if (meta > fsize || 0 == hdr->narrays || 0 == hdr->next_id) {
+        goto bad;
+    }
+    ents = (const snap_arr_t *)(hdr + 1);
+    free_ids = (const uint32_t *)(ents + hdr->narrays);
+    if (0 != ents[0].id) {
+        goto bad;
+    }
+    if (hdr->next_id > vm->as.tab_len &&
+        SUCCESS != (rc = as_grow(&vm->as, hdr->next_id - 1))) {
+        return rc;
+    }
+    for (i = 0; i < hdr->narrays; ++i) {
+        const snap_arr_t *e = &ents[i];
+        asi_t *asi = NULL;
+        if (e->off < meta || 0 != e->off % vm->word_size ||
+            e->off + (uint64_t)e->nwords * vm->word_size > fsize ||
+            e->id >= hdr->next_id || NULL != vm->as.tab[e->id]) {
+            goto bad;
+        }
+        if (NULL == (asi = pool_alloc(vm->pool, sizeof(*asi)))) {
+            return ERR_OOR;
+        }
+        asi->addp = (uint32_t *)((char *)map + e->off);
+        asi->addp_len = e->nwords;
+        asi->kind = ASI_IMAGE;
+        vm->as.tab[e->id] = asi;
+        if (0 != e->id) {
+            vm->as.live_arrays++;
+            vm->as.live_words += e->nwords;
+        }
+    }
+    /* as far back as we can see */
+    vm->as.peak_arrays = vm->as.live_arrays;
+    vm->as.peak_words = vm->as.live_words;
+    vm->zap = vm->as.tab[0];
+    if (0 != hdr->zshare) {
+        asi_t *src = getasip(vm, hdr->zshare);
+        if (hdr->zshare >= hdr->next_id || NULL == src ||
+            src->addp != vm->zap->addp) {
+            goto bad;
+        }
+        if (NULL == (src->refs = pool_alloc(vm->pool, sizeof(*src->refs)))) {
+            return ERR_OOR;
+        }
+        *src->refs = 2;
+        vm->zap->refs = src->refs;
+    }
+    vm->as.next_id = hdr->next_id;
+    for (i = 0; i < hdr->nfree; ++i) {
+        if (0 == free_ids[i] || free_ids[i] >= hdr->next_id ||
+            NULL != vm->as.tab[free_ids[i]]) {
+            goto bad;
+        }
+        if (SUCCESS != (rc = putid(vm, free_ids[i]))) {
+            return rc;
+        }
+    }
+    if (0 != vmio_unread(vm->io, free_ids + hdr->nfree, hdr->ilen)) {
+        goto bad;
+    }
+    (void)memcpy(vm->mr, hdr->mr, sizeof(vm->mr));
+    vm->pc = hdr->pc;
+    vm->icount = hdr->icount;
+    vm->app_size = vm->zap->addp_len * vm->word_size;
+    return SUCCESS;
+
+bad:
+    fprintf(stderr, "snapshot is corrupt\n");
+    return ERR_INVLD_INPUT;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* array id as the machine has it now, NULL if it isn't live */
+static inline asi_t *
+ck_array(const vm_t *vm,
+         uint32_t id)
+{
+    return (0 == id) ? vm->zap : vm->as.tab[id];
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * captures a checkpoint record and hands it to the writer. a base has every
+ * live array. a delta has the arrays whose payload isn't the one in the view
+ * (written, allocated or replaced since) and the ids that were live in the
+ * view and aren't anymore. either way the live arrays then become the new
+ * view, which is the only copy-on-write there is: nothing is copied here.
+ */
+static int
+write_checkpoint(vm_t *vm,
+                 bool base)
+{
+    struct ckpt_job job;
+    struct vmio *io = vm->io;
+    asi_t *view = NULL;
+    uint32_t id, n = 0, nfreed = 0, nids = vm->as.next_id;
+    uint64_t words = 0;
+    int rc = SUCCESS;
+
+    /* the last record's payloads are in the view we are about to drop */
+    if (0 != ckpt_wait(vm->ck)) {
+        int err = errno;
+        fprintf(stderr, "checkpoint write failure: %d (%s)\n", err,
+                strerror(err));
         return ERR_IO;
     }
-    while ((bread = read(fd, &ibuf, sizeof(ibuf)))) {
-        if (-1 == bread) {
-            int err = errno;
-            fprintf(stderr, "read failure: %d (%s)\n", err, strerror(err));
-            rc = ERR_IO;
-            goto out;
+    (void)memset(&job, 0, sizeof(job));
+    for (id = 0; id < nids; ++id) {
+        const asi_t *asi = ck_array(vm, id);
+        const asi_t *v = (id < vm->ck_nview) ? &vm->ck_view[id] : NULL;
+        bool was = NULL != v && NULL != v->refs;
+        if (NULL == asi) {
+            nfreed += (!base && was);
         }
-        else if (sizeof(ibuf) != bread) {
-            fprintf(stderr, "read inconsistency: read: %lu expected: %lu\n",
-                    (unsigned long)bread, (unsigned long)sizeof(ibuf));
-            rc = ERR_IO;
-            goto out;
+        else if (base || !was || asi->refs != v->refs) {
+            job.rec.narrays++;
         }
-        /* else all is well, so append word to program "0" array */
-        zap->addp[word_index++] = htonl(ibuf);
     }
-    /* finish setting up vm state */
-    vm->app_size = word_index * vm->word_size;
-    /* sanity */
-    if (vm->app_size != fsize) {
-        fprintf(stderr, "read inconsistency: expected: %lu read: %lu\n",
-                (unsigned long)fsize, vm->app_size);
-        return ERR;
+    job.rec.base = base;
+    job.rec.nfreed = nfreed;
+    job.rec.nfree = vm->as.free_len;
+    job.rec.ilen = (uint32_t)(io->ilen - io->ipos);
+    if (NULL == (view = calloc(nids, sizeof(*view))) ||
+        NULL == (job.ents = malloc((job.rec.narrays + 1) *
+                                   sizeof(*job.ents))) ||
+        NULL == (job.data = malloc((job.rec.narrays + 1) *
+                                   sizeof(*job.data))) ||
+        NULL == (job.ids = malloc((nfreed + job.rec.nfree + 1) *
+                                  sizeof(*job.ids))) ||
+        NULL == (job.input = malloc(job.rec.ilen + 1))) {
+        rc = ERR_OOR;
+        goto err;
     }
+    for (id = 0; id < nids; ++id) {
+        asi_t *asi = ck_array(vm, id);
+        const asi_t *v = (id < vm->ck_nview) ? &vm->ck_view[id] : NULL;
+        bool was = NULL != v && NULL != v->refs;
+        if (NULL == asi) {
+            if (!base && was) job.ids[--nfreed] = id;
+            continue;
+        }
+        if (base || !was || asi->refs != v->refs) {
+            job.ents[n].id = id;
+            job.ents[n].nwords = (uint32_t)asi->addp_len;
+            job.data[n++] = asi->addp;
+            words += asi->addp_len;
+        }
+        if (SUCCESS != (rc = view_share(vm, asi, &view[id]))) {
+            goto err;
+        }
+    }
+    (void)memcpy(job.ids + job.rec.nfreed, vm->as.free_ids,
+                 job.rec.nfree * sizeof(*job.ids));
+    (void)memcpy(job.input, io->ibuf + io->ipos, job.rec.ilen);
+    (void)memcpy(job.rec.mr, vm->mr, sizeof(job.rec.mr));
+    job.rec.pc = vm->pc;
+    job.rec.next_id = nids;
+    job.rec.icount = vm->icount;
+    /* the guest may have said something we haven't passed on yet */
+    (void)vmio_flush(io);
+    view_release(vm);
+    vm->ck_view = view;
+    vm->ck_nview = nids;
+    ckpt_submit(vm->ck, &job);
+    if (base) {
+        vm->ck_bases++;
+        vm->ck_base_words = words;
+        vm->ck_delta_words = 0;
+    }
+    else {
+        vm->ck_deltas++;
+        vm->ck_delta_words += words;
+    }
+    vm->ck_words += words;
+    return SUCCESS;
 
-out:
-    if (-1 != fd) {
-        close(fd);
+err:
+    if (NULL != view) {
+        for (id = 0; id < nids; ++id) {
+            if (NULL != view[id].refs) asi_release(vm, &view[id]);
+        }
     }
+    free(view);
+    free(job.ents);
+    free(job.data);
+    free(job.ids);
+    free(job.input);
     return rc;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
+/* plays one complete record onto the handle table */
 static int
-run(vm_t *vm)
+ckpt_apply(vm_t *vm,
+           const ckpt_rec_t *rec,
+           uint32_t *top)
 {
-    int rc;
+    const ckpt_arr_t *ents = (const ckpt_arr_t *)(rec + 1);
+    const uint32_t *ids = (const uint32_t *)(ents + rec->narrays);
+    uint32_t *pay = (uint32_t *)((char *)(rec + 1) + ckpt_lists_len(rec));
+    uint32_t id, i;
+    int rc = SUCCESS;
 
-    while (true) {
-        rc = doop(vm);
-        if (unlikely(SUCCESS != rc)) {
-            if (HALT == rc) {
-                rc = SUCCESS;
+    if (0 == rec->next_id || rec->next_id < *top) {
+        return ERR_INVLD_INPUT;
+    }
+    if (rec->base) {
+        for (id = 0; id < *top; ++id) {
+            if (NULL != vm->as.tab[id]) {
+                asi_destruct(vm, vm->as.tab[id]);
+                vm->as.tab[id] = NULL;
             }
-            break;
         }
     }
-    return rc;
+    if (rec->next_id > vm->as.tab_len &&
+        SUCCESS != (rc = as_grow(&vm->as, rec->next_id - 1))) {
+        return rc;
+    }
+    *top = rec->next_id;
+    for (i = 0; i < rec->nfreed; ++i) {
+        if (0 == ids[i] || ids[i] >= *top || NULL == vm->as.tab[ids[i]]) {
+            return ERR_INVLD_INPUT;
+        }
+        asi_destruct(vm, vm->as.tab[ids[i]]);
+        vm->as.tab[ids[i]] = NULL;
+    }
+    for (i = 0; i < rec->narrays; ++i) {
+        asi_t *asi = NULL;
+        if (ents[i].id >= *top) {
+            return ERR_INVLD_INPUT;
+        }
+        if (NULL == (asi = vm->as.tab[ents[i].id])) {
+            if (NULL == (asi = pool_alloc(vm->pool, sizeof(*asi)))) {
+                return ERR_OOR;
+            }
+            asi->refs = NULL;
+            asi->kind = ASI_IMAGE;
+            vm->as.tab[ents[i].id] = asi;
+        }
+        asi->addp = pay;
+        asi->addp_len = ents[i].nwords;
+        pay += ents[i].nwords;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * picks the machine up from a mapped checkpoint log: the base, then every
+ * complete delta after it. like a snapshot, the arrays are used in place.
+ */
+static int
+restore_checkpoint(vm_t *vm,
+                   void *map,
+                   size_t fsize)
+{
+    const ckpt_rec_t *rec = NULL, *last = NULL;
+    const uint32_t *free_ids = NULL;
+    size_t off = 0;
+    uint32_t id, i, top = 0;
+    int rc = SUCCESS, more;
+
+    /* the mapping is ours from here on, whatever happens */
+    vm->img = map;
+    vm->img_len = fsize;
+
+    if (NULL != vm->arena) {
+        fprintf(stderr, "checkpoints don't work with the arena\n");
+        return ERR_INVLD_INPUT;
+    }
+    while (1 == (more = ckpt_next(map, fsize, &off, &rec))) {
+        /* only a base can start the log */
+        if ((NULL == last && !rec->base) ||
+            SUCCESS != (rc = ckpt_apply(vm, rec, &top))) {
+            goto bad;
+        }
+        last = rec;
+    }
+    if (0 > more) {
+        fprintf(stderr, "checkpoint log is for another host or version\n");
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == last) {
+        fprintf(stderr, "checkpoint log has no complete record\n");
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (vm->zap = vm->as.tab[0])) {
+        goto bad;
+    }
+    for (id = 1; id < top; ++id) {
+        if (NULL != vm->as.tab[id]) {
+            vm->as.live_arrays++;
+            vm->as.live_words += vm->as.tab[id]->addp_len;
+        }
+    }
+    vm->as.peak_arrays = vm->as.live_arrays;
+    vm->as.peak_words = vm->as.live_words;
+    vm->as.next_id = top;
+    free_ids = (const uint32_t *)((const ckpt_arr_t *)(last + 1) +
+                                  last->narrays) + last->nfreed;
+    for (i = 0; i < last->nfree; ++i) {
+        if (0 == free_ids[i] || free_ids[i] >= top ||
+            NULL != vm->as.tab[free_ids[i]]) {
+            goto bad;
+        }
+        if (SUCCESS != (rc = putid(vm, free_ids[i]))) {
+            return rc;
+        }
+    }
+    if (0 != vmio_unread(vm->io, free_ids + last->nfree, last->ilen)) {
+        goto bad;
+    }
+    (void)memcpy(vm->mr, last->mr, sizeof(vm->mr));
+    vm->pc = last->pc;
+    vm->icount = last->icount;
+    vm->app_size = vm->zap->addp_len * vm->word_size;
+    if (off != fsize) {
+        fprintf(stderr, WARN_PREFIX "checkpoint log ends in an incomplete "
+                "or damaged record. restored the one before it.\n");
+    }
+    return SUCCESS;
+
+bad:
+    if (ERR_OOR == rc) {
+        return rc;
+    }
+    fprintf(stderr, "checkpoint log is corrupt\n");
+    return ERR_INVLD_INPUT;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* true if the mapped image is a pre-swapped image this host can run as is */
+static bool
+is_native_image(const void *map,
+                size_t fsize)
+{
+    const nimg_hdr_t *hdr = (const nimg_hdr_t *)map;
+
+    if (fsize < sizeof(*hdr) ||
+        0 != memcmp(hdr->magic, NIMG_MAGIC, sizeof(hdr->magic))) {
+        return false;
+    }
+    if (NIMG_ENDIAN != hdr->endian) {
+        fprintf(stderr, WARN_PREFIX "pre-swapped image is for the other "
+                "byte order. loading it as a plain image.\n");
+        return false;
+    }
+    if ((fsize - sizeof(*hdr)) / sizeof(uint32_t) != hdr->nwords) {
+        fprintf(stderr, WARN_PREFIX "pre-swapped image is truncated. "
+                "loading it as a plain image.\n");
+        return false;
+    }
+    return true;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* copies a plain or pre-swapped image into a new zero array */
+static int
+load_buf(vm_t *vm,
+         const void *buf,
+         size_t len)
+{
+    const uint32_t *words = (const uint32_t *)buf;
+    size_t nwords = 0;
+    bool swap = true;
+    int rc = SUCCESS;
+
+    if (is_native_image(buf, len)) {
+        words = (const uint32_t *)((const nimg_hdr_t *)buf + 1);
+        len -= sizeof(nimg_hdr_t);
+        swap = false;
+    }
+    /* sanity */
+    if (0 != len % vm->word_size) {
+        fprintf(stderr, "read inconsistency: %lu is not a multiple of %lu\n",
+                (unsigned long)len, (unsigned long)vm->word_size);
+        return ERR_IO;
+    }
+    nwords = len / vm->word_size;
+    if (SUCCESS != (rc = alloc_array(vm, nwords, NULL))) {
+        return rc;
+    }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    swap = false;
+#endif
+    if (!swap || 0 != (uintptr_t)words % sizeof(*words)) {
+        if (0 != len) {
+            (void)memcpy(vm->zap->addp, words, len);
+        }
+        if (swap) {
+            bswap32_copy(vm->zap->addp, vm->zap->addp, nwords);
+        }
+    }
+    else {
+        bswap32_copy(vm->zap->addp, words, nwords);
+    }
+    /* finish setting up vm state */
+    vm->app_size = len;
+    return SUCCESS;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * maps the image and byte-swaps it into the zero array in one go. a
+ * pre-swapped image (see write_native_image) is used in place: the zero array
+ * points straight into the private mapping, which lives until vm_destruct.
+ */
 static int
-go(const char *exe)
+load_app(vm_t *vm, const char *exe)
 {
+    int fd = -1;
     int rc = SUCCESS;
-    vm_t *vm = NULL;
+    size_t fsize = 0;
+    void *map = MAP_FAILED;
+
+    if (NULL == vm || NULL == exe) return ERR_INVLD_INPUT;
 
-    if (SUCCESS != (rc = vm_construct(&vm))) {
-        fprintf(stderr, "vm_construct error: %d\n", rc);
+    if (SUCCESS != (rc = get_file_size(exe, &fsize))) {
         return rc;
     }
-    if (SUCCESS != (rc = load_app(vm, exe))) {
-        fprintf(stderr, "load_app error: %d\n", rc);
-        /* rc is set */
+    if (-1 == (fd = open(exe, O_RDONLY))) {
+        int err = errno;
+        fprintf(stderr, "open failure: %d (%s)\n", err, strerror(err));
+        return ERR_IO;
+    }
+    if (0 != fsize) {
+        map = mmap(NULL, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map) {
+            int err = errno;
+            fprintf(stderr, "mmap failure: %d (%s)\n", err, strerror(err));
+            rc = ERR_IO;
+            goto out;
+        }
+    }
+    if (MAP_FAILED != map && fsize >= sizeof(snap_hdr_t) &&
+        0 == memcmp(map, SNAP_MAGIC, sizeof(((snap_hdr_t *)0)->magic))) {
+        rc = restore_snapshot(vm, map, fsize);
+        /* vm owns the mapping now */
+        map = MAP_FAILED;
         goto out;
     }
-    if (SUCCESS != (rc = run(vm))) {
-        fprintf(stderr, "run error: %d\n", rc);
+    if (MAP_FAILED != map && fsize >= sizeof(ckpt_file_t) &&
+        0 == memcmp(map, CKPT_MAGIC, sizeof(((ckpt_file_t *)0)->magic))) {
+        rc = restore_checkpoint(vm, map, fsize);
+        map = MAP_FAILED;
         goto out;
     }
+    if (MAP_FAILED != map && is_native_image(map, fsize)) {
+        const nimg_hdr_t *hdr = (const nimg_hdr_t *)map;
+        asi_t *zap = NULL;
+
+        if (NULL == (zap = pool_alloc(vm->pool, sizeof(*zap)))) {
+            rc = ERR_OOR;
+            goto out;
+        }
+        zap->addp = (uint32_t *)((char *)map + sizeof(*hdr));
+        zap->addp_len = hdr->nwords;
+        zap->kind = ASI_IMAGE;
+        vm->zap = vm->as.tab[0] = zap;
+        vm->img = map;
+        vm->img_len = fsize;
+        vm->app_size = hdr->nwords * vm->word_size;
+        /* the zero array owns the mapping now */
+        map = MAP_FAILED;
+        goto out;
+    }
+    rc = load_buf(vm, (MAP_FAILED != map) ? map : NULL, fsize);
 
 out:
-    vm_destruct(vm);
+    if (MAP_FAILED != map) {
+        (void)munmap(map, fsize);
+    }
+    if (-1 != fd) {
+        close(fd);
+    }
     return rc;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
-static void
-usage(void)
+/* writes the zero array out as a pre-swapped image */
+static int
+write_native_image(const vm_t *vm,
+                   const char *path)
+{
+    nimg_hdr_t hdr;
+    FILE *f = NULL;
+    int rc = SUCCESS;
+
+    (void)memset(&hdr, 0, sizeof(hdr));
+    (void)memcpy(hdr.magic, NIMG_MAGIC, sizeof(hdr.magic));
+    hdr.endian = NIMG_ENDIAN;
+    hdr.nwords = (uint32_t)vm->zap->addp_len;
+
+    if (NULL == (f = fopen(path, "wb"))) {
+        int err = errno;
+        fprintf(stderr, "open failure: %d (%s)\n", err, strerror(err));
+        return ERR_IO;
+    }
+    if (1 != fwrite(&hdr, sizeof(hdr), 1, f) ||
+        vm->zap->addp_len != fwrite(vm->zap->addp, vm->word_size,
+                                    vm->zap->addp_len, f)) {
+        int err = errno;
+        fprintf(stderr, "write failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+    }
+    if (0 != fclose(f) && SUCCESS == rc) {
+        int err = errno;
+        fprintf(stderr, "write failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static always_inline int
+run_as(vm_t *vm,
+       const bool checked)
 {
-    printf("usage: %s APP\n", PACKAGE);
+    int rc;
+
+    while (true) {
+        rc = doop_as(vm, checked);
+        if (unlikely(SUCCESS != rc)) {
+            if (HALT == rc || YIELD == rc) {
+                vm->icount++;
+                rc = (HALT == rc) ? SUCCESS : YIELD;
+            }
+            break;
+        }
+        vm->icount++;
+    }
+    return rc;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
+static int
+run(vm_t *vm)
+{
+    return run_as(vm, true);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * the switch engine without its checks, for images that are known not to
+ * index out of bounds, use dead arrays, divide by zero or hit bad opcodes.
+ */
+static int
+run_unchecked(vm_t *vm)
+{
+    return run_as(vm, false);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
-int
-main(int argc, char **argv)
+/*
+ * the switch engine, with every instruction going into the trace before it
+ * runs. so a failing instruction is the last one in the trace. this is what
+ * runs traced machines, whichever engine was asked for.
+ */
+static int
+run_traced(vm_t *vm)
 {
-    int rc = ERR;
+    struct trace *t = vm->trace;
+    int rc;
 
-    /* enough args? */
-    if (2 != argc) {
-        usage();
-        return EXIT_FAILURE;
+    while (true) {
+        if (unlikely(vm->pc >= vm->zap->addp_len)) {
+            fprintf(stderr, "pc out of bounds: %"PRIu32"\n", vm->pc);
+            rc = ERR;
+            break;
+        }
+        trace_insn(t, vm->pc, vm->zap->addp[vm->pc], vm->mr);
+        rc = doop(vm);
+        if (unlikely(SUCCESS != rc)) {
+            if (HALT == rc || YIELD == rc) {
+                vm->icount++;
+                rc = (HALT == rc) ? SUCCESS : YIELD;
+            }
+            break;
+        }
+        vm->icount++;
     }
-    /* valid path? */
-    else if (-1 == access(argv[1], F_OK | R_OK)) {
-        int err = errno;
-        fprintf(stderr, "cannot read %s - %s.\n", argv[1], strerror(err));
-        usage();
-        return EXIT_FAILURE;
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * direct-threaded engine. runs out of the predecoded copy of the zero array
+ * (see pd_build), so each instruction is a jump to its handler with the
+ * register indices already pulled out. the instruction pointer and the
+ * register file live in locals and are spilled back to vm around operations
+ * that leave the engine (alloc, dealloc, i/o, loadprog) and on the way out.
+ *
+ * instructions are counted per straight-line run: pc only moves by one
+ * between jumps, so the count is settled whenever pc is reassigned.
+ */
+static int
+run_threaded(vm_t *vm)
+{
+    /* entry 16 is the end-of-program sentinel */
+    static const void *const optab[17] = {
+        &&op0,  &&op1,  &&op2,  &&op3,  &&op4,  &&op5,  &&op6,  &&op7,
+        &&op8,  &&op9,  &&op10, &&op11, &&op12, &&op13, &&bad,  &&bad,
+        &&pcoob
+    };
+    uint32_t r[N_REGISTERS];
+    const pdi_t *pd = NULL, *ip = NULL;
+    /* start of the current straight-line run */
+    const pdi_t *seg = NULL;
+    size_t zlen = vm->zap->addp_len;
+    uint64_t icount = vm->icount;
+    int rc = SUCCESS;
+
+    vm->thr_optab = optab;
+    if (NULL == vm->pd && SUCCESS != (rc = pd_build(vm))) {
+        return rc;
+    }
+    if (unlikely(vm->pc >= zlen)) {
+        fprintf(stderr, "pc out of bounds: %"PRIu32"\n", vm->pc);
+        return ERR;
+    }
+    pd = vm->pd;
+    ip = seg = pd + vm->pc;
+
+#define PC() ((uint32_t)(ip - pd))
+
+#define SPILL()                                                                \
+do {                                                                           \
+    (void)memcpy(vm->mr, r, sizeof(r));                                        \
+    vm->pc = PC();                                                             \
+} while (0)
+
+#ifdef VMDEUX_PROFILE
+/* the sentinel past the end is not an instruction */
+#define DISPATCH()                                                             \
+do {                                                                           \
+    PROF(vm, if (likely(PC() < zlen)) {                                        \
+        prof_insn(prof_, PC(), vm->zap->addp[PC()]);                           \
+    });                                                                        \
+    goto *ip->h;                                                               \
+} while (0)
+#else
+#define DISPATCH() goto *ip->h
+#endif
+
+#define NEXT()                                                                 \
+do {                                                                           \
+    ++ip;                                                                      \
+    DISPATCH();                                                                \
+} while (0)
+
+    (void)memcpy(r, vm->mr, sizeof(r));
+    DISPATCH();
+
+op0:
+    if (0 != r[ip->c]) {
+        r[ip->a] = r[ip->b];
+    }
+    NEXT();
+op1: {
+    asi_t *asi = NULL;
+    if (NULL != vm->arena && 0 != r[ip->b]) {
+        uint32_t len = 0;
+        const uint32_t *p = arena_array(vm->arena, r[ip->b], &len);
+        if (unlikely(NULL == p || r[ip->c] >= len)) {
+            fprintf(stderr, "array oob @ line %d: "
+                    "requested: %"PRIu32" but max is: %"PRIu32"\n",
+                    __LINE__, r[ip->c], len);
+            rc = ERR;
+            goto out;
+        }
+        r[ip->a] = p[r[ip->c]];
+        NEXT();
+    }
+    if (unlikely(NULL == (asi = getasip(vm, r[ip->b])))) {
+        rc = ERR;
+        goto out;
+    }
+    if (unlikely(r[ip->c] >= asi->addp_len)) {
+        fprintf(stderr, "array oob @ line %d: "
+                "requested: %"PRIu32" but max is: %lu\n",
+                __LINE__, r[ip->c], (unsigned long)asi->addp_len);
+        rc = ERR;
+        goto out;
+    }
+    r[ip->a] = asi->addp[r[ip->c]];
+    NEXT();
+}
+op2: {
+    asi_t *asi = NULL;
+    if (NULL != vm->arena && 0 != r[ip->a]) {
+        uint32_t len = 0;
+        uint32_t *p = arena_array(vm->arena, r[ip->a], &len);
+        if (unlikely(NULL == p || r[ip->b] >= len)) {
+            fprintf(stderr, "array oob @ line %d: "
+                    "requested: %"PRIu32" but max is: %"PRIu32"\n",
+                    __LINE__, r[ip->b], len);
+            rc = ERR;
+            goto out;
+        }
+        p[r[ip->b]] = r[ip->c];
+        NEXT();
+    }
+    if (unlikely(NULL == (asi = getasip(vm, r[ip->a])))) {
+        rc = ERR;
+        goto out;
+    }
+    if (unlikely(r[ip->b] >= asi->addp_len)) {
+        fprintf(stderr, "array oob @ line %d: "
+                "requested: %"PRIu32" but max is: %lu\n",
+                __LINE__, r[ip->b], (unsigned long)asi->addp_len);
+        rc = ERR;
+        goto out;
+    }
+    if (unlikely(NULL != asi->refs && SUCCESS != asi_unshare(vm, asi))) {
+        rc = ERR_OOR;
+        goto out;
+    }
+    asi->addp[r[ip->b]] = r[ip->c];
+    if (unlikely(0 == r[ip->a])) {
+        /* self-modifying code */
+        pd_decode(vm, &vm->pd[r[ip->b]], r[ip->c]);
+    }
+    NEXT();
+}
+op3:
+    r[ip->a] = r[ip->b] + r[ip->c];
+    NEXT();
+op4:
+    r[ip->a] = r[ip->b] * r[ip->c];
+    NEXT();
+op5:
+    if (unlikely(0 == r[ip->c])) {
+        fprintf(stderr, "div by 0 @ %d\n", __LINE__);
+        rc = ERR;
+        goto out;
+    }
+    r[ip->a] = r[ip->b] / r[ip->c];
+    NEXT();
+op6:
+    r[ip->a] = ~(r[ip->b] & r[ip->c]);
+    NEXT();
+op7:
+    /* halt retires, but pc stays put */
+    ++icount;
+    goto out;
+op8: {
+    uint32_t id = 0;
+    SPILL();
+    if (unlikely(SUCCESS != (rc = alloc_array(vm, r[ip->c], &id)))) {
+        if (ERR_LIMIT != rc) {
+            rc = ERR;
+        }
+        goto out;
+    }
+    r[ip->b] = id;
+    NEXT();
+}
+op9:
+    SPILL();
+    if (unlikely(SUCCESS != dealloc_array(vm, r[ip->c]))) {
+        fprintf(stderr, "dealloc array failure @ %d\n", __LINE__);
+        rc = ERR;
+        goto out;
+    }
+    NEXT();
+op10:
+    SPILL();
+    vm_out(vm, r[ip->c]);
+    NEXT();
+op11:
+    SPILL();
+    rc = vm_in(vm, &r[ip->c], icount + (uint64_t)(ip - seg), false);
+    if (unlikely(SUCCESS != rc)) {
+        goto out;
+    }
+    NEXT();
+op12: {
+    /* settled now -- loadprog may move the predecoded array */
+    uint64_t n = (uint64_t)(ip - seg) + 1;
+    uint32_t target = r[ip->c];
+
+    if (0 != r[ip->b]) {
+        SPILL();
+        if (unlikely(SUCCESS != (rc = loadprog(vm, r[ip->b])))) {
+            goto out;
+        }
+        pd = vm->pd;
+        zlen = vm->zap->addp_len;
+    }
+    icount += n;
+    if (unlikely(target >= zlen)) {
+        fprintf(stderr, "pc out of bounds: %"PRIu32"\n", target);
+        vm->pc = target;
+        vm->icount = icount;
+        (void)memcpy(vm->mr, r, sizeof(r));
+        return ERR;
+    }
+    ip = seg = pd + target;
+    if (unlikely(icount >= vm->ilimit)) {
+        rc = YIELD;
+        goto out;
+    }
+    DISPATCH();
+}
+op13:
+    r[ip->a] = ip->x;
+    NEXT();
+bad:
+    fprintf(stderr, "invalid op @ %d\n", __LINE__);
+    rc = ERR_IOOB;
+    goto out;
+pcoob:
+    fprintf(stderr, "pc out of bounds: %"PRIu32"\n", PC());
+    rc = ERR;
+    goto out;
+
+out:
+    vm->icount = icount + (uint64_t)(ip - seg);
+    SPILL();
+    return rc;
+
+#undef NEXT
+#undef DISPATCH
+#undef SPILL
+#undef PC
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * jit runtime callbacks. these only report failure -- the faulting
+ * instruction is then run through doop, which says what went wrong.
+ */
+static int
+jrt_aidx(void *ctx,
+         uint32_t id,
+         uint32_t idx,
+         uint32_t *val)
+{
+    vm_t *vm = (vm_t *)ctx;
+    asi_t *asi = NULL;
+
+    if (NULL != vm->arena && 0 != id) {
+        uint32_t len = 0;
+        const uint32_t *p = arena_array(vm->arena, id, &len);
+        if (unlikely(NULL == p || idx >= len)) {
+            return ERR;
+        }
+        *val = p[idx];
+        return SUCCESS;
+    }
+    asi = getasip(vm, id);
+    if (unlikely(NULL == asi || idx >= asi->addp_len)) {
+        return ERR;
+    }
+    *val = asi->addp[idx];
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+jrt_aupd(void *ctx,
+         uint32_t id,
+         uint32_t idx,
+         uint32_t val)
+{
+    vm_t *vm = (vm_t *)ctx;
+    asi_t *asi = NULL;
+
+    if (NULL != vm->arena && 0 != id) {
+        uint32_t len = 0;
+        uint32_t *p = arena_array(vm->arena, id, &len);
+        if (unlikely(NULL == p || idx >= len)) {
+            return ERR;
+        }
+        p[idx] = val;
+        return SUCCESS;
+    }
+    asi = getasip(vm, id);
+    if (unlikely(NULL == asi || idx >= asi->addp_len)) {
+        return ERR;
+    }
+    if (unlikely(NULL != asi->refs && SUCCESS != asi_unshare(vm, asi))) {
+        return ERR_OOR;
+    }
+    asi->addp[idx] = val;
+    if (unlikely(0 == id)) {
+        pd_update(vm, idx, val);
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+jrt_alloc(void *ctx,
+          uint32_t nwords,
+          uint32_t *id)
+{
+    vm_t *vm = (vm_t *)ctx;
+
+    /* leave the complaint to the interpreter, which tries it again */
+    if (unlikely(over_limit(&vm->as, nwords))) {
+        return ERR_LIMIT;
+    }
+    return alloc_array(vm, nwords, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+jrt_dealloc(void *ctx,
+            uint32_t id)
+{
+    vm_t *vm = (vm_t *)ctx;
+
+    if (unlikely(0 == id || !array_live(vm, id))) {
+        return ERR;
+    }
+    return dealloc_array(vm, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+jrt_out(void *ctx,
+        uint32_t val)
+{
+    vm_out((vm_t *)ctx, val);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+jrt_in(void *ctx,
+       uint32_t *val,
+       uint32_t k)
+{
+    vm_t *vm = (vm_t *)ctx;
+
+    return vm_in(vm, val, vm->jf.icount + k, true);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static int
+jrt_loadprog(void *ctx,
+             uint32_t id)
+{
+    vm_t *vm = (vm_t *)ctx;
+
+    if (unlikely(!array_live(vm, id))) {
+        return ERR;
+    }
+    return loadprog(vm, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static void
+jrt_zero(void *ctx,
+         uint32_t **base,
+         uint32_t *len,
+         uint32_t *wlen)
+{
+    vm_t *vm = (vm_t *)ctx;
+
+    *base = vm->zap->addp;
+    *len = (uint32_t)vm->zap->addp_len;
+    /* a shared zero array has to go through jrt_aupd to be written */
+    *wlen = (NULL == vm->zap->refs) ? *len : 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * jit engine. translated code runs until it halts or hits something it
+ * doesn't handle, which is then run through doop one instruction at a time.
+ * translations are kept in vm between calls. hosts that can't run translated
+ * code get the threaded engine.
+ */
+static int
+run_jit(vm_t *vm)
+{
+    static const struct jit_rt rt = {
+        jrt_aidx, jrt_aupd, jrt_alloc, jrt_dealloc,
+        jrt_out, jrt_in, jrt_loadprog, jrt_zero
+    };
+    struct jit_frame *f = &vm->jf;
+    int rc = SUCCESS, jrc;
+
+#ifdef VMDEUX_PROFILE
+    /* translated code isn't instrumented */
+    if (NULL != vm->prof) {
+        return run_threaded(vm);
+    }
+#endif
+    if (NULL == vm->jit) {
+        if (vm->no_jit) {
+            return run_threaded(vm);
+        }
+        f->ctx = vm;
+        if (NULL == (vm->jit = jit_create(&rt, f))) {
+            fprintf(stderr, WARN_PREFIX "jit unavailable on this host. "
+                    "using the threaded engine.\n");
+            vm->no_jit = true;
+            return run_threaded(vm);
+        }
+    }
+    /* the zero array may have changed under us since the last call */
+    if ((f->zbase != vm->zap->addp || f->zlen != vm->zap->addp_len) &&
+        0 != jit_reset(vm->jit)) {
+        OOR_COMPLAIN();
+        return ERR_OOR;
+    }
+    /* or been shared with a checkpoint, which leaves it where it was */
+    f->zwlen = (NULL == vm->zap->refs) ? f->zlen : 0;
+    (void)memcpy(f->mr, vm->mr, sizeof(f->mr));
+    f->pc = vm->pc;
+    f->icount = vm->icount;
+    f->ilimit = vm->ilimit;
+    /* an interrupt may have come in between the two */
+    if (vm->intr) {
+        f->ilimit = 0;
+    }
+
+    while (true) {
+        uint32_t w, id, idx;
+        asi_t *zap = vm->zap;
+        uint32_t *zbase = zap->addp;
+
+        jrc = jit_exec(vm->jit);
+        (void)memcpy(vm->mr, f->mr, sizeof(vm->mr));
+        vm->pc = f->pc;
+        vm->icount = f->icount;
+        if (JIT_HALT == jrc) {
+            break;
+        }
+        else if (JIT_YIELD == jrc) {
+            rc = YIELD;
+            break;
+        }
+        else if (jrc < 0) {
+            OOR_COMPLAIN();
+            rc = ERR_OOR;
+            break;
+        }
+        /* JIT_INTERP */
+        if (unlikely(vm->pc >= zap->addp_len)) {
+            fprintf(stderr, "pc out of bounds: %"PRIu32"\n", vm->pc);
+            rc = ERR;
+            break;
+        }
+        w = zap->addp[vm->pc];
+        id = vm->mr[(w & RA) >> 6];
+        idx = vm->mr[(w & RB) >> 3];
+        if (SUCCESS != (rc = doop(vm))) {
+            if (HALT == rc || YIELD == rc) {
+                vm->icount++;
+                rc = (HALT == rc) ? SUCCESS : YIELD;
+            }
+            /* a loadprog that yields is picked up on the way back in */
+            break;
+        }
+        vm->icount++;
+        if (zbase != zap->addp) {
+            /* loadprog */
+            if (0 != jit_reset(vm->jit)) {
+                OOR_COMPLAIN();
+                rc = ERR_OOR;
+                break;
+            }
+        }
+        else if (OP2 == (w & OP_MASK) && 0 == id) {
+            jit_written(vm->jit, idx);
+        }
+        (void)memcpy(f->mr, vm->mr, sizeof(f->mr));
+        f->pc = vm->pc;
+        f->icount = vm->icount;
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+typedef int (*engine_fn_t)(vm_t *vm);
+
+/* execution engines selectable with --engine. the first one is the default. */
+static const struct {
+    const char *name;
+    engine_fn_t run;
+} engines[] = {
+    {"switch",    run},
+    {"threaded",  run_threaded},
+    {"jit",       run_jit},
+    {"unchecked", run_unchecked},
+    {NULL,        NULL}
+};
+
+#define N_ENGINES (sizeof(engines) / sizeof(engines[0]) - 1)
+
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* libvmdeux -- see vmdeux.h */
+/* ////////////////////////////////////////////////////////////////////////// */
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_create(vmdeux_t **vm,
+              const struct vmdeux_config *config)
+{
+    return vm_construct(vm, config);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_destroy(vmdeux_t *vm)
+{
+    return vm_destruct(vm);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_load(vmdeux_t *vm,
+            const void *buf,
+            size_t len)
+{
+    if (NULL == vm || (NULL == buf && 0 != len) || NULL != vm->zap) {
+        return ERR_INVLD_INPUT;
+    }
+    if (len >= sizeof(snap_hdr_t) &&
+        0 == memcmp(buf, SNAP_MAGIC, strlen(SNAP_MAGIC))) {
+        fprintf(stderr, "snapshots can only be loaded from a file\n");
+        return ERR_INVLD_INPUT;
+    }
+    return load_buf(vm, buf, len);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_load_file(vmdeux_t *vm,
+                 const char *path)
+{
+    if (NULL == vm || NULL != vm->zap) {
+        return ERR_INVLD_INPUT;
+    }
+    return load_app(vm, path);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_engine(const char *name)
+{
+    int i;
+
+    for (i = 0; NULL != engines[i].name; ++i) {
+        if (0 == strcmp(name, engines[i].name)) return i;
+    }
+    return -1;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+const char *
+vmdeux_engine_name(int engine)
+{
+    if (0 > engine || N_ENGINES <= (size_t)engine) {
+        return NULL;
+    }
+    return engines[engine].name;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_run(vmdeux_t *vm,
+           int engine,
+           uint64_t limit)
+{
+    int rc;
+
+    if (NULL == vm || NULL == vm->zap || NULL == vmdeux_engine_name(engine)) {
+        return ERR_INVLD_INPUT;
+    }
+    vm->ilimit = limit;
+    /* an interrupt that came in before we got here still counts */
+    if (vm->intr) {
+        vm->ilimit = 0;
+    }
+    rc = (NULL != vm->trace) ? run_traced(vm) : engines[engine].run(vm);
+    if (YIELD == rc) {
+        vm->intr = 0;
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_interrupt(vmdeux_t *vm)
+{
+    vm_interrupt(vm);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_flush(vmdeux_t *vm)
+{
+    return (0 == vmio_flush(vm->io)) ? SUCCESS : ERR_IO;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_stats(const vmdeux_t *vm,
+             struct vmdeux_stats *st)
+{
+    (void)memset(st, 0, sizeof(*st));
+    st->icount = vm->icount;
+    st->live_arrays = vm->as.live_arrays;
+    st->live_words = vm->as.live_words;
+    st->peak_arrays = vm->as.peak_arrays;
+    st->peak_words = vm->as.peak_words;
+    st->nlimited = vm->as.nlimited;
+    st->zero_words = (NULL != vm->zap) ? vm->zap->addp_len : 0;
+    st->nloadprog = vm->nloadprog;
+    st->cow_shared = vm->cow_shared;
+    st->cow_copied = vm->cow_copied;
+    st->in_bytes = vm->io->in_bytes;
+    st->out_bytes = vm->io->out_bytes;
+    st->app_size = vm->app_size;
+    st->image = vm->img_shared ? "shared image" : "plain image";
+    if (NULL != vm->img) {
+        st->image = (0 == memcmp(vm->img, SNAP_MAGIC, strlen(SNAP_MAGIC))) ?
+                    "snapshot" : "pre-swapped image";
+        if (0 == memcmp(vm->img, CKPT_MAGIC, strlen(CKPT_MAGIC))) {
+            st->image = "checkpoint log";
+        }
+    }
+    st->ck_bases = vm->ck_bases;
+    st->ck_deltas = vm->ck_deltas;
+    st->ck_words = vm->ck_words;
+    st->bswap = bswap32_impl();
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_report(const vmdeux_t *vm,
+              FILE *f,
+              unsigned what)
+{
+    if ((what & VMDEUX_REPORT_JIT) && NULL != vm->jit) {
+        jit_stats(vm->jit, f);
+    }
+    if (what & VMDEUX_REPORT_POOL) {
+        pool_stats(vm->pool, f);
+        if (NULL != vm->arena) {
+            arena_stats(vm->arena, f);
+        }
+    }
+    if ((what & VMDEUX_REPORT_PROFILE) && NULL != vm->prof &&
+        NULL != vm->zap) {
+        prof_report(vm->prof, f, opstrs, vm->zap->addp, vm->zap->addp_len);
+    }
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_snapshot(vmdeux_t *vm,
+                const char *path)
+{
+    if (NULL == vm || NULL == vm->zap || NULL == path) {
+        return ERR_INVLD_INPUT;
+    }
+    return write_snapshot(vm, path);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_checkpoint_start(vmdeux_t *vm,
+                        const char *path)
+{
+    int rc = SUCCESS;
+
+    if (NULL == vm || NULL == vm->zap || NULL == path || NULL != vm->ck) {
+        return ERR_INVLD_INPUT;
+    }
+    /* arena ids are offsets, and arena arrays can't be shared */
+    if (NULL != vm->arena) {
+        fprintf(stderr, "checkpoints don't work with the arena\n");
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (vm->ck = ckpt_create(path))) {
+        int err = errno;
+        fprintf(stderr, "cannot start checkpoint log %s: %d (%s)\n", path,
+                err, strerror(err));
+        return ERR_OOR;
+    }
+    if (SUCCESS != (rc = write_checkpoint(vm, true))) {
+        (void)ckpt_destroy(vm->ck);
+        vm->ck = NULL;
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_checkpoint(vmdeux_t *vm)
+{
+    if (NULL == vm || NULL == vm->ck) {
+        return ERR_INVLD_INPUT;
+    }
+    /* once the deltas outweigh the base, restoring is cheaper from a new one */
+    return write_checkpoint(vm, vm->ck_delta_words > vm->ck_base_words);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_record(vmdeux_t *vm,
+              const char *path)
+{
+    if (NULL == vm || NULL == path || NULL != vm->rec) {
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (vm->rec = replay_record(path))) {
+        int err = errno;
+        fprintf(stderr, "cannot write %s: %d (%s)\n", path, err,
+                strerror(err));
+        return ERR_IO;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_replay(vmdeux_t *vm,
+              const char *path)
+{
+    if (NULL == vm || NULL == path || NULL != vm->replay) {
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (vm->replay = replay_open(path))) {
+        int err = errno;
+        if (EINVAL == err) {
+            fprintf(stderr, "%s is not an input log\n", path);
+            return ERR_INVLD_INPUT;
+        }
+        fprintf(stderr, "cannot read %s: %d (%s)\n", path, err,
+                strerror(err));
+        return ERR_IO;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_trace_dump(const vmdeux_t *vm,
+                  const char *path)
+{
+    if (NULL == vm || NULL == vm->trace || NULL == path) {
+        return ERR_INVLD_INPUT;
+    }
+    if (0 != trace_dump(vm->trace, path)) {
+        int err = errno;
+        fprintf(stderr, "trace write failure: %s: %d (%s)\n", path, err,
+                strerror(err));
+        return ERR_IO;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_trace_stream(vmdeux_t *vm,
+                    const char *path)
+{
+    if (NULL == vm || NULL == vm->trace || NULL == path) {
+        return ERR_INVLD_INPUT;
+    }
+    if (0 != trace_stream(vm->trace, path)) {
+        int err = errno;
+        fprintf(stderr, "cannot stream the trace to %s: %d (%s)\n", path,
+                err, strerror(err));
+        return ERR_IO;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_trace_print(const char *path,
+                   FILE *f)
+{
+    if (NULL == path || NULL == f) {
+        return ERR_INVLD_INPUT;
+    }
+    if (0 != trace_print(path, f, opstrs)) {
+        int err = errno;
+        if (EINVAL == err) {
+            fprintf(stderr, "%s is not a trace\n", path);
+            return ERR_INVLD_INPUT;
+        }
+        fprintf(stderr, "cannot read %s: %d (%s)\n", path, err,
+                strerror(err));
+        return ERR_IO;
+    }
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_get_regs(const vmdeux_t *vm,
+                struct vmdeux_regs *regs)
+{
+    (void)memcpy(regs->mr, vm->mr, sizeof(regs->mr));
+    regs->pc = vm->pc;
+    regs->icount = vm->icount;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_set_regs(vmdeux_t *vm,
+                const struct vmdeux_regs *regs)
+{
+    (void)memcpy(vm->mr, regs->mr, sizeof(vm->mr));
+    vm->pc = regs->pc;
+    vm->icount = regs->icount;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * the instructions translated code can't do by itself. like the jit
+ * callbacks they are, they fail without a word and leave the complaint to
+ * the interpreter, which runs the instruction again.
+ */
+int
+vmdeux_aidx(vmdeux_t *vm,
+            uint32_t id,
+            uint32_t idx,
+            uint32_t *val)
+{
+    return jrt_aidx(vm, id, idx, val);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_aupd(vmdeux_t *vm,
+            uint32_t id,
+            uint32_t idx,
+            uint32_t val)
+{
+    return jrt_aupd(vm, id, idx, val);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_alloc(vmdeux_t *vm,
+             uint32_t nwords,
+             uint32_t *id)
+{
+    return jrt_alloc(vm, nwords, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_dealloc(vmdeux_t *vm,
+               uint32_t id)
+{
+    return jrt_dealloc(vm, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_out(vmdeux_t *vm,
+           uint32_t val)
+{
+    vm_out(vm, val);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_in(vmdeux_t *vm,
+          uint32_t *val,
+          uint64_t icount)
+{
+    return vm_in(vm, val, icount, true);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_loadprog(vmdeux_t *vm,
+                uint32_t id)
+{
+    return jrt_loadprog(vm, id);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+const uint32_t *
+vmdeux_zero(const vmdeux_t *vm,
+            size_t *nwords)
+{
+    *nwords = vm->zap->addp_len;
+    return vm->zap->addp;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_write_c(const vmdeux_t *vm,
+               const char *path,
+               const char *src)
+{
+    FILE *f = NULL;
+    bool snapshot = false;
+    int rc = SUCCESS;
+
+    if (NULL == vm || NULL == vm->zap || NULL == path || NULL == src) {
+        return ERR_INVLD_INPUT;
+    }
+    if (0 == vm->zap->addp_len) {
+        fprintf(stderr, "there is no program to translate\n");
+        return ERR_INVLD_INPUT;
+    }
+    snapshot = NULL != vm->img &&
+               0 == memcmp(vm->img, SNAP_MAGIC, strlen(SNAP_MAGIC));
+    if (!snapshot && 0 != vm->icount) {
+        fprintf(stderr, "only a program that hasn't started, or a "
+                "snapshot, can be translated\n");
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (f = fopen(path, "w"))) {
+        int err = errno;
+        fprintf(stderr, "open failure: %d (%s)\n", err, strerror(err));
+        return ERR_IO;
+    }
+    if (0 != aot_emit(f, vm->zap->addp, vm->zap->addp_len, vm->pc, src,
+                      snapshot ? src : NULL)) {
+        int err = errno;
+        fprintf(stderr, "write failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+    }
+    if (0 != fclose(f) && SUCCESS == rc) {
+        int err = errno;
+        fprintf(stderr, "write failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+    }
+    return rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_write_image(const vmdeux_t *vm,
+                   const char *path)
+{
+    if (NULL == vm || NULL == vm->zap || NULL == path) {
+        return ERR_INVLD_INPUT;
+    }
+    return write_native_image(vm, path);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* a loaded program that machines run from without copying it */
+struct vmdeux_image {
+    /* host byte order */
+    const uint32_t *words;
+    size_t nwords;
+    /* pre-swapped images are used straight out of their mapping */
+    void *map;
+    size_t map_len;
+    /* plain images are swapped into here */
+    uint32_t *buf;
+};
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_image_open(vmdeux_image_t **img,
+                  const char *path)
+{
+    vmdeux_image_t *tmp = NULL;
+    size_t fsize = 0;
+    void *map = MAP_FAILED;
+    int fd = -1, rc = SUCCESS;
+
+    if (NULL == img || NULL == path) return ERR_INVLD_INPUT;
+    if (SUCCESS != (rc = get_file_size(path, &fsize))) {
+        return rc;
+    }
+    if (NULL == (tmp = calloc(1, sizeof(*tmp)))) {
+        return ERR_OOR;
+    }
+    if (-1 == (fd = open(path, O_RDONLY))) {
+        int err = errno;
+        fprintf(stderr, "open failure: %d (%s)\n", err, strerror(err));
+        rc = ERR_IO;
+        goto out;
+    }
+    if (0 != fsize) {
+        map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map) {
+            int err = errno;
+            fprintf(stderr, "mmap failure: %d (%s)\n", err, strerror(err));
+            rc = ERR_IO;
+            goto out;
+        }
+    }
+    if (MAP_FAILED != map && fsize >= sizeof(snap_hdr_t) &&
+        0 == memcmp(map, SNAP_MAGIC, strlen(SNAP_MAGIC))) {
+        fprintf(stderr, "snapshots can't be shared\n");
+        rc = ERR_INVLD_INPUT;
+        goto out;
+    }
+    if (MAP_FAILED != map && is_native_image(map, fsize)) {
+        const nimg_hdr_t *hdr = (const nimg_hdr_t *)map;
+        tmp->words = (const uint32_t *)(hdr + 1);
+        tmp->nwords = hdr->nwords;
+        tmp->map = map;
+        tmp->map_len = fsize;
+        /* the image owns the mapping now */
+        map = MAP_FAILED;
+        goto out;
+    }
+    if (0 != fsize % sizeof(uint32_t)) {
+        fprintf(stderr, "read inconsistency: %lu is not a multiple of %lu\n",
+                (unsigned long)fsize, (unsigned long)sizeof(uint32_t));
+        rc = ERR_IO;
+        goto out;
+    }
+    tmp->nwords = fsize / sizeof(uint32_t);
+    /* never NULL, even for an empty program */
+    if (NULL == (tmp->buf = malloc(fsize + sizeof(uint32_t)))) {
+        rc = ERR_OOR;
+        goto out;
+    }
+    if (MAP_FAILED != map) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        (void)memcpy(tmp->buf, map, fsize);
+#else
+        bswap32_copy(tmp->buf, (const uint32_t *)map, tmp->nwords);
+#endif
+    }
+    tmp->words = tmp->buf;
+
+out:
+    if (MAP_FAILED != map) {
+        (void)munmap(map, fsize);
+    }
+    if (-1 != fd) {
+        close(fd);
+    }
+    if (SUCCESS != rc) {
+        vmdeux_image_close(tmp);
+        return rc;
+    }
+    *img = tmp;
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmdeux_image_close(vmdeux_image_t *img)
+{
+    if (NULL == img) return;
+    if (NULL != img->map) {
+        (void)munmap(img->map, img->map_len);
+    }
+    free(img->buf);
+    free(img);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_image_wrap(vmdeux_image_t **img,
+                  const uint32_t *words,
+                  size_t nwords)
+{
+    vmdeux_image_t *tmp = NULL;
+
+    if (NULL == img || NULL == words) return ERR_INVLD_INPUT;
+    if (NULL == (tmp = calloc(1, sizeof(*tmp)))) {
+        return ERR_OOR;
+    }
+    tmp->words = words;
+    tmp->nwords = nwords;
+    *img = tmp;
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/*
+ * the zero array borrows the image's words as if loadprog had shared them
+ * with an array that never lets go, so the first write makes a private copy.
+ */
+int
+vmdeux_load_shared(vmdeux_t *vm,
+                   const vmdeux_image_t *img)
+{
+    asi_t *zap = NULL;
+
+    if (NULL == vm || NULL == img || NULL != vm->zap) {
+        return ERR_INVLD_INPUT;
+    }
+    if (NULL == (zap = pool_alloc(vm->pool, sizeof(*zap)))) {
+        return ERR_OOR;
+    }
+    if (NULL == (zap->refs = pool_alloc(vm->pool, sizeof(*zap->refs)))) {
+        pool_free(vm->pool, zap, sizeof(*zap));
+        return ERR_OOR;
+    }
+    *zap->refs = 2;
+    zap->addp = (uint32_t *)img->words;
+    zap->addp_len = img->nwords;
+    zap->kind = ASI_IMAGE;
+    vm->zap = vm->as.tab[0] = zap;
+    vm->app_size = img->nwords * vm->word_size;
+    vm->img_shared = true;
+    return SUCCESS;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_step(vmdeux_t *vm)
+{
+    int rc;
+
+    if (NULL == vm || NULL == vm->zap) {
+        return ERR_INVLD_INPUT;
+    }
+    if (unlikely(vm->pc >= vm->zap->addp_len)) {
+        fprintf(stderr, "pc out of bounds: %"PRIu32"\n", vm->pc);
+        return ERR;
+    }
+    /* so a jump doesn't stop on whatever limit the last run had */
+    vm->ilimit = UINT64_MAX;
+    if (NULL != vm->trace) {
+        trace_insn(vm->trace, vm->pc, vm->zap->addp[vm->pc], vm->mr);
+    }
+    rc = doop(vm);
+    if (SUCCESS == rc || HALT == rc || YIELD == rc) {
+        vm->icount++;
+    }
+    return (YIELD == rc) ? SUCCESS : rc;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+uint64_t
+vmdeux_hash(const vmdeux_t *vm)
+{
+    uint64_t h = FNV_INIT;
+    uint32_t id;
+
+    h = fnv_words(h, vm->zap->addp, vm->zap->addp_len);
+    /* arena ids are offsets, so the arena as laid out is the whole story */
+    if (NULL != vm->arena) {
+        return fnv_words(h, vm->arena->base, (size_t)vm->arena->top);
+    }
+    for (id = 1; id < vm->as.next_id; ++id) {
+        const asi_t *asi = vm->as.tab[id];
+        uint32_t len = 0;
+        if (NULL == asi) continue;
+        len = (uint32_t)asi->addp_len;
+        h = fnv_words(h, &id, 1);
+        h = fnv_words(h, &len, 1);
+        h = fnv_words(h, asi->addp, asi->addp_len);
+    }
+    return h;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmdeux_disasm(uint32_t w,
+              char *buf,
+              size_t len)
+{
+    const char *op = opstrs[w >> 28];
+
+    if (NULL == op) {
+        return snprintf(buf, len, "invalid");
     }
-    /* if we are here, then we can read the input file */
-    if (SUCCESS != (rc = go(argv[1]))) {
-        return EXIT_FAILURE;
+    if (OP13 == (w & OP_MASK)) {
+        return snprintf(buf, len, "%-8s r%u %#"PRIx32"", op,
+                        (unsigned)((w >> 25) & 7), w & 0x01FFFFFFU);
     }
-    return EXIT_SUCCESS;
+    return snprintf(buf, len, "%-8s r%u r%u r%u", op, (unsigned)((w & RA) >> 6),
+                    (unsigned)((w & RB) >> 3), (unsigned)(w & RC));
 }
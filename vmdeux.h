@@ -0,0 +1,283 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libvmdeux -- an embeddable universal machine.
+ *
+ * every machine keeps all of its state in its vmdeux_t, so any number of them
+ * can live in one process. a machine must only be used by one thread at a
+ * time; vmdeux_interrupt is the exception.
+ */
+
+#ifndef VMDEUX_VMDEUX_H
+#define VMDEUX_VMDEUX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* return codes */
+enum {
+    VMDEUX_SUCCESS = 0,
+    VMDEUX_ERR,
+    /* out of resources */
+    VMDEUX_ERR_OOR,
+    VMDEUX_ERR_IO,
+    /* invalid instruction */
+    VMDEUX_ERR_IOOB,
+    VMDEUX_ERR_INVLD_INPUT,
+    /*
+     * the guest halted. only vmdeux_step returns it. vmdeux_run returns
+     * VMDEUX_SUCCESS instead.
+     */
+    VMDEUX_HALT,
+    /* vmdeux_run stopped at its limit or on vmdeux_interrupt */
+    VMDEUX_YIELD,
+    /* vmdeux_run stopped at an input instruction with no input ready */
+    VMDEUX_WAIT,
+    /* an allocation was refused because of max_arrays or max_words */
+    VMDEUX_ERR_LIMIT
+};
+
+/* what vmdeux_report prints */
+#define VMDEUX_REPORT_JIT     0x1U
+#define VMDEUX_REPORT_POOL    0x2U
+#define VMDEUX_REPORT_PROFILE 0x4U
+
+typedef struct vm_t vmdeux_t;
+/* a program image that any number of machines can run from at once */
+typedef struct vmdeux_image vmdeux_image_t;
+
+/*
+ * console callbacks. read returns the number of bytes read, 0 at end of
+ * input and -1 on error. write returns the number of bytes written (which
+ * may be short) or -1 on error. both are retried on EINTR. a read that fails
+ * with EAGAIN makes vmdeux_run return VMDEUX_WAIT.
+ */
+struct vmdeux_io {
+    void *ctx;
+    long (*read)(void *ctx, void *buf, size_t len);
+    long (*write)(void *ctx, const void *buf, size_t len);
+};
+
+struct vmdeux_config {
+    /* NULL callbacks mean stdin and stdout */
+    struct vmdeux_io io;
+    /* flush output after every newline */
+    bool line_flush;
+    /* count opcodes and hot program counters. needs VMDEUX_PROFILE. */
+    bool profile;
+    /*
+     * caps on the arrays the guest can have allocated at once and the words
+     * they can hold, not counting the zero array. 0 means no cap.
+     */
+    uint64_t max_arrays;
+    uint64_t max_words;
+    /*
+     * keep arrays in one arena, where an id is the array's offset, instead
+     * of a handle table. loads and stores skip the table lookup. machines
+     * using it can't be snapshotted.
+     */
+    bool arena;
+    /* merge free arena space and give it back once half of it is free */
+    bool arena_compact;
+    /* ask for transparent huge pages for arrays of 2 MiB and up */
+    bool thp;
+    /*
+     * if not 0, keep the last trace_len (rounded up to a power of two)
+     * instructions run in an execution trace. traced machines run a tracing
+     * switch engine whatever engine is asked for.
+     */
+    uint64_t trace_len;
+};
+
+struct vmdeux_stats {
+    /* instructions retired */
+    uint64_t icount;
+    /* arrays other than the zero array, and the words they hold */
+    uint64_t live_arrays;
+    uint64_t live_words;
+    /* the most there ever were of each */
+    uint64_t peak_arrays;
+    uint64_t peak_words;
+    /* allocations refused because of a cap */
+    uint64_t nlimited;
+    uint64_t zero_words;
+    uint64_t nloadprog;
+    /*
+     * bytes loadprog shared, and bytes copied later because a shared array
+     * was written. checkpoints share arrays too, so with them the second
+     * can be the bigger.
+     */
+    uint64_t cow_shared;
+    uint64_t cow_copied;
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    /* size of what was loaded */
+    uint64_t app_size;
+    /* checkpoint records captured, and the array words in them */
+    uint64_t ck_bases;
+    uint64_t ck_deltas;
+    uint64_t ck_words;
+    /*
+     * "plain image", "pre-swapped image", "shared image", "snapshot" or
+     * "checkpoint log"
+     */
+    const char *image;
+    /* byte swap kernel the loader uses */
+    const char *bswap;
+};
+
+/* config may be NULL */
+int vmdeux_create(vmdeux_t **vm, const struct vmdeux_config *config);
+int vmdeux_destroy(vmdeux_t *vm);
+/* loads a program image (big-endian words, or pre-swapped) from memory */
+int vmdeux_load(vmdeux_t *vm, const void *buf, size_t len);
+/* maps a program image, pre-swapped image or snapshot */
+int vmdeux_load_file(vmdeux_t *vm, const char *path);
+
+/*
+ * loads a program image (plain or pre-swapped) for sharing. it is read-only
+ * from then on and has to outlive every machine it is loaded into.
+ */
+int vmdeux_image_open(vmdeux_image_t **img, const char *path);
+void vmdeux_image_close(vmdeux_image_t *img);
+/* an image of nwords words in host byte order, which have to outlive it */
+int vmdeux_image_wrap(vmdeux_image_t **img, const uint32_t *words,
+                      size_t nwords);
+/* runs img without copying it. a machine copies it before it writes to it. */
+int vmdeux_load_shared(vmdeux_t *vm, const vmdeux_image_t *img);
+
+/* engine index by name, -1 if there is no such engine. 0 is the default. */
+int vmdeux_engine(const char *name);
+/* engine name by index, NULL past the last one */
+const char *vmdeux_engine_name(int engine);
+
+/*
+ * runs the machine until it halts (VMDEUX_SUCCESS), fails, retires limit
+ * instructions in total (VMDEUX_YIELD) or wants input that isn't there yet
+ * (VMDEUX_WAIT). limits are only checked at jumps, so a run may go a little
+ * past its limit. UINT64_MAX means no limit. a machine that yielded or is
+ * waiting picks up where it left off on the next call, with any engine.
+ */
+int vmdeux_run(vmdeux_t *vm, int engine, uint64_t limit);
+/* makes vmdeux_run return VMDEUX_YIELD soon. async-signal-safe. */
+void vmdeux_interrupt(vmdeux_t *vm);
+
+/* writes out buffered guest output */
+int vmdeux_flush(vmdeux_t *vm);
+void vmdeux_stats(const vmdeux_t *vm, struct vmdeux_stats *st);
+/* prints the VMDEUX_REPORT_ things in what that are available */
+void vmdeux_report(const vmdeux_t *vm, FILE *f, unsigned what);
+
+/* saves the whole machine. vmdeux_load_file picks it back up. */
+int vmdeux_snapshot(vmdeux_t *vm, const char *path);
+/*
+ * starts a checkpoint log at path with a base record of the whole machine.
+ * vmdeux_load_file picks the machine up from the last complete record. not
+ * with the arena.
+ */
+int vmdeux_checkpoint_start(vmdeux_t *vm, const char *path);
+/*
+ * adds a record of the arrays written, allocated or freed since the last
+ * one. once those add up to more than the base, it starts the log over with
+ * a new base instead. the machine is only held up long enough to note what
+ * changed: its arrays are shared with a background writer and copied when
+ * written, like after a loadprog. returns VMDEUX_ERR_IO if an earlier record
+ * couldn't be written.
+ */
+int vmdeux_checkpoint(vmdeux_t *vm);
+/*
+ * logs every value the guest reads, with the instruction count it was read
+ * at, to path. for feeding back with vmdeux_replay.
+ */
+int vmdeux_record(vmdeux_t *vm, const char *path);
+/*
+ * takes the guest's input from a log vmdeux_record wrote instead of the read
+ * callback, which is never called. the guest reads end of input once the log
+ * runs out. a read at any other instruction count than the one logged fails.
+ */
+int vmdeux_replay(vmdeux_t *vm, const char *path);
+/*
+ * writes the last instructions run to path, oldest first. an instruction
+ * that failed is the last one. one retried after waiting for input shows up
+ * twice.
+ */
+int vmdeux_trace_dump(const vmdeux_t *vm, const char *path);
+/*
+ * writes every instruction from here on to path from a background thread.
+ * the machine waits for the writer if it gets too far ahead.
+ */
+int vmdeux_trace_stream(vmdeux_t *vm, const char *path);
+/* prints a trace file, one instruction per line */
+int vmdeux_trace_print(const char *path, FILE *f);
+/* writes the zero array as a pre-swapped image */
+int vmdeux_write_image(const vmdeux_t *vm, const char *path);
+/*
+ * writes a C program that runs the zero array translated, and the
+ * interpreter from the first instruction translated code can't take on.
+ * src is where vm was loaded from. the program has to be at its start, or
+ * loaded from a snapshot, which the C program then loads from src itself.
+ */
+int vmdeux_write_c(const vmdeux_t *vm, const char *path, const char *src);
+
+/*
+ * for translated code (vmdeux_write_c). it keeps the machine's registers
+ * itself and hands them back before it leaves for vmdeux_run.
+ */
+struct vmdeux_regs {
+    uint32_t mr[8];
+    uint32_t pc;
+    /* instructions retired */
+    uint64_t icount;
+};
+
+void vmdeux_get_regs(const vmdeux_t *vm, struct vmdeux_regs *regs);
+void vmdeux_set_regs(vmdeux_t *vm, const struct vmdeux_regs *regs);
+/*
+ * the instructions. these return VMDEUX_SUCCESS or fail quietly, in which
+ * case the instruction is left to vmdeux_run, which says what went wrong.
+ * a write to array 0 or a loadprog changes what vmdeux_zero has, which
+ * translated code has to check for itself. icount is the count before the
+ * input instruction.
+ */
+int vmdeux_aidx(vmdeux_t *vm, uint32_t id, uint32_t idx, uint32_t *val);
+int vmdeux_aupd(vmdeux_t *vm, uint32_t id, uint32_t idx, uint32_t val);
+int vmdeux_alloc(vmdeux_t *vm, uint32_t nwords, uint32_t *id);
+int vmdeux_dealloc(vmdeux_t *vm, uint32_t id);
+void vmdeux_out(vmdeux_t *vm, uint32_t val);
+int vmdeux_in(vmdeux_t *vm, uint32_t *val, uint64_t icount);
+int vmdeux_loadprog(vmdeux_t *vm, uint32_t id);
+/* the zero array as it is now */
+const uint32_t *vmdeux_zero(const vmdeux_t *vm, size_t *nwords);
+
+/*
+ * runs exactly one instruction the way the switch engine would, which
+ * vmdeux_run can't do: engines only stop at jumps. returns VMDEUX_HALT if it
+ * was a halt.
+ */
+int vmdeux_step(vmdeux_t *vm);
+/*
+ * hash of the contents of every array, under its id. machines that ran the
+ * same program the same way hash the same.
+ */
+uint64_t vmdeux_hash(const vmdeux_t *vm);
+/* an instruction as text, snprintf style */
+int vmdeux_disasm(uint32_t w, char *buf, size_t len);
+
+#endif /* VMDEUX_VMDEUX_H */
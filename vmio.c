@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmio.h"
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+fd_read(void *ctx,
+        void *buf,
+        size_t len)
+{
+    (void)ctx;
+    return (long)read(STDIN_FILENO, buf, len);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static long
+fd_write(void *ctx,
+         const void *buf,
+         size_t len)
+{
+    (void)ctx;
+    return (long)write(STDOUT_FILENO, buf, len);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+struct vmio *
+vmio_create(const struct vmio_cb *cb)
+{
+    struct vmio *io = NULL;
+
+    if (NULL == (io = calloc(1, sizeof(*io)))) {
+        return NULL;
+    }
+    if (NULL != cb) {
+        io->cb = *cb;
+    }
+    if (NULL == io->cb.read) {
+        io->cb.read = fd_read;
+    }
+    if (NULL == io->cb.write) {
+        io->cb.write = fd_write;
+    }
+    return io;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+void
+vmio_destroy(struct vmio *io)
+{
+    if (NULL == io) return;
+    (void)vmio_flush(io);
+    free(io);
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmio_flush(struct vmio *io)
+{
+    size_t off = 0;
+    long n = 0;
+
+    while (off < io->olen && !io->oerr) {
+        n = io->cb.write(io->cb.ctx, io->obuf + off, io->olen - off);
+        if (0 > n && EINTR == errno) continue;
+        /* a write that takes nothing would have us spin */
+        if (0 >= n) {
+            io->oerr = true;
+            break;
+        }
+        off += (size_t)n;
+    }
+    io->olen = 0;
+    return io->oerr ? -1 : 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmio_getc(struct vmio *io,
+          uint32_t *val)
+{
+    long n = 0;
+
+    if (__builtin_expect(io->ipos == io->ilen, 0)) {
+        if (io->eof) {
+            *val = VMIO_EOF;
+            return 0;
+        }
+        /* whoever is on the other end may be waiting for our output */
+        (void)vmio_flush(io);
+        do {
+            n = io->cb.read(io->cb.ctx, io->ibuf, sizeof(io->ibuf));
+        } while (0 > n && EINTR == errno);
+        if (0 > n) {
+            return (EAGAIN == errno || EWOULDBLOCK == errno) ? VMIO_AGAIN : -1;
+        }
+        if (0 == n) {
+            io->eof = true;
+            *val = VMIO_EOF;
+            return 0;
+        }
+        io->ipos = 0;
+        io->ilen = (size_t)n;
+    }
+    *val = io->ibuf[io->ipos++];
+    io->in_bytes++;
+    return 0;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+int
+vmio_unread(struct vmio *io,
+            const void *buf,
+            size_t len)
+{
+    size_t left = io->ilen - io->ipos;
+
+    if (len > VMIO_BUF_SIZE - left) {
+        return -1;
+    }
+    (void)memmove(io->ibuf + len, io->ibuf + io->ipos, left);
+    (void)memcpy(io->ibuf, buf, len);
+    io->ipos = 0;
+    io->ilen = len + left;
+    return 0;
+}
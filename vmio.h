@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2013 Samuel K. Gutierrez All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMDEUX_VMIO_H
+#define VMDEUX_VMIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* size of the input and output buffers */
+#define VMIO_BUF_SIZE (1 << 16)
+
+/* what the machine reads once input is exhausted */
+#define VMIO_EOF 0xFFFFFFFFU
+
+/* vmio_getc found no input ready */
+#define VMIO_AGAIN 1
+
+/*
+ * where the bytes come from and go to. read returns bytes read, 0 at end of
+ * input or -1. write returns bytes written or -1. -1 with errno EINTR is
+ * retried. a read that fails with EAGAIN can be tried again later.
+ */
+struct vmio_cb {
+    void *ctx;
+    long (*read)(void *ctx, void *buf, size_t len);
+    long (*write)(void *ctx, const void *buf, size_t len);
+};
+
+/*
+ * console i/o for the machine. output collects in a buffer that goes out
+ * through the write callback when it fills up, before input has to be read,
+ * and on vmio_flush. input is read in VMIO_BUF_SIZE blocks.
+ */
+struct vmio {
+    struct vmio_cb cb;
+    /* also flush after every newline */
+    bool line_flush;
+    /* input is exhausted */
+    bool eof;
+    /* a write failed. output is dropped from then on. */
+    bool oerr;
+    unsigned char obuf[VMIO_BUF_SIZE];
+    size_t olen;
+    unsigned char ibuf[VMIO_BUF_SIZE];
+    size_t ipos;
+    size_t ilen;
+    /* bytes handed to and taken from the machine */
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+};
+
+/* NULL callbacks read stdin and write stdout */
+struct vmio *vmio_create(const struct vmio_cb *cb);
+/* flushes first */
+void vmio_destroy(struct vmio *io);
+int vmio_flush(struct vmio *io);
+/*
+ * stores VMIO_EOF at end of input. returns -1 on read errors and VMIO_AGAIN
+ * if the read callback had nothing yet, in which case val is untouched.
+ */
+int vmio_getc(struct vmio *io, uint32_t *val);
+/* queues len bytes ahead of the input descriptor. returns -1 if no room. */
+int vmio_unread(struct vmio *io, const void *buf, size_t len);
+
+/* ////////////////////////////////////////////////////////////////////////// */
+static inline void
+vmio_putc(struct vmio *io,
+          uint32_t val)
+{
+    if (__builtin_expect(VMIO_BUF_SIZE == io->olen, 0)) {
+        (void)vmio_flush(io);
+    }
+    io->obuf[io->olen++] = (unsigned char)val;
+    io->out_bytes++;
+    if (io->line_flush && '\n' == (unsigned char)val) {
+        (void)vmio_flush(io);
+    }
+}
+
+#endif /* VMDEUX_VMIO_H */